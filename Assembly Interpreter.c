@@ -1,6 +1,77 @@
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+//-DASM_BENCHMARK builds the benchmark harness at the end of the file as main. it reads the hardware counters and
+//counts every allocation the interpreter makes. link with -ldl for --aot. it leaves the profiler out, whose hooks
+//would slow the switch engine alone.
+#ifdef ASM_BENCHMARK
+#include <dlfcn.h>
+#ifndef ASM_COUNTERS
+#define ASM_COUNTERS
+#endif
+_Atomic long long benchAllocations;
+
+static inline void* countedMalloc(size_t size) {
+    benchAllocations++;
+    return malloc(size);
+}
+
+static inline void* countedCalloc(size_t count, size_t size) {
+    benchAllocations++;
+    return calloc(count, size);
+}
+
+static inline void* countedRealloc(void* old, size_t size) {
+    benchAllocations++;
+    return realloc(old, size);
+}
+
+#define malloc(size) countedMalloc(size)
+#define calloc(count, size) countedCalloc(count, size)
+#define realloc(old, size) countedRealloc(old, size)
+#endif
+
+//-DASM_SERVER builds a daemon at the end of the file as main that runs programs sent to it over a Unix socket.
+#ifdef ASM_SERVER
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#endif
+
+//-DASM_COUNTERS adds hardware counters around the phases of a run, see measureRun. they come from perf_event_open
+//on Linux, wherever they can not be opened only the time is measured.
+#if defined(ASM_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define HAVE_COUNTERS 1
+#else
+#define HAVE_COUNTERS 0
+#endif
+
+//the lexer finds token boundaries a whole vector at a time where the target has one, -DSCALAR_LEXER turns it off.
+#if defined(__GNUC__) && defined(__AVX2__) && !defined(SCALAR_LEXER)
+#include <immintrin.h>
+#define LEXER_VECTOR 32
+#elif defined(__GNUC__) && defined(__SSE2__) && !defined(SCALAR_LEXER)
+#include <emmintrin.h>
+#define LEXER_VECTOR 16
+#else
+#define LEXER_VECTOR 0
+#endif
 
 #define MOV 0
 #define INC 1
@@ -22,14 +93,227 @@
 #define RET 17
 #define MSG 18
 #define END 19
+#define BADEND 20
+
+//superinstructions written by the peephole pass. each one sits in the first slot of the sequence it replaces.
+#define CMPJ 21
+#define INCJ 22
+#define DECJ 23
+#define MOVOP 24
+
+#define IS_CONDITIONAL(op) ((op) >= JNE && (op) <= JL)
+#define FUSED_LENGTH(op) ((op) == INCJ || (op) == DECJ ? 3 : (op) == CMPJ || (op) == MOVOP ? 2 : 1)
+
+//compile options. compileProgram runs every OPTIMIZE_ALL pass, the rest are asked for by name.
+#define OPTIMIZE_NONE 0
+#define OPTIMIZE_FUSE 1
+#define OPTIMIZE_DATAFLOW 2
+#define OPTIMIZE_INLINE 4
+#define OPTIMIZE_ALL (OPTIMIZE_FUSE | OPTIMIZE_DATAFLOW | OPTIMIZE_INLINE)
+//not an optimization: the data-flow pass no longer assumes main starts with every register zeroed. programs
+//run with executeFrom or executeLanes need it.
+#define OPTIMIZE_SEEDED 8
+//not one either: the program is also compiled to native code. only hot programs, run often or for long, repay
+//that, without it a program stays on the threaded engine until setEngine asks for ENGINE_JIT.
+#define OPTIMIZE_JIT 16
+//what a pooled interpreter compiles with. its programs are small and run once, the passes would cost more than
+//they save and each takes memory of its own.
+#define POOL_OPTIONS OPTIMIZE_NONE
+
+//phases of compileTimed. encoding includes the optimizer passes, loading picks and prepares the engine.
+#define PHASE_LEX 0
+#define PHASE_LINK 1
+#define PHASE_ENCODE 2
+#define PHASE_LOAD 3
+#define NUM_PHASES 4
+
+//subroutines with at most this many instructions before their ret are copied into their callers.
+#define INLINE_BUDGET 8
+
+//register sets of the data-flow pass: one bit per register and one for the cmpX/cmpY pair.
+#define FLOW_CMP (1u << 26)
+#define FLOW_ALL ((1u << 27) - 1)
+#define FLOW_REG(r) ((r) == NO_REG ? 0u : 1u << (r))
 
 #define MAX_LBL 20
-#define MAX_MSG 50
 #define NUM_OPS 20
-#define MAX_CODE_LEN 200
+#define NO_REG 0xFF
+#define ARENA_BLOCK 4096
+#define ARENA_MAX_BLOCK (1 << 20)
+#define MIN_CAPACITY 16
+#define MIN_OUTPUT 64
+#define SINK_BLOCK (64 * 1024)
+
+//calls nest this deep by default before a run fails, see setCallDepth. the JIT's private stack holds one return
+//address per level plus room for the C it calls into.
+#define MAX_CALL_DEPTH 1000000
+#define JIT_STACK_SLACK (64 * 1024)
+
+//program images are written in host byte order, the version changes whenever Bytecode or the layout does.
+#define IMAGE_MAGIC 0x4D495341
+#define IMAGE_VERSION 3
+
+#define ENGINE_SWITCH 0
+#define ENGINE_THREADED 1
+#define ENGINE_JIT 2
+
+//-DASM_PROFILE builds the profiler into the switch engine, see executeProfiled. without it the hooks are empty.
+#ifdef ASM_PROFILE
+#define PROFILE_STEP(ctx, instr) if ((ctx)->profile != NULL) profileStep((ctx)->profile, (ctx), (instr))
+#define PROFILE_CALL(ctx, instr) if ((ctx)->profile != NULL) profileCall((ctx)->profile, (instr))
+#define PROFILE_RET(ctx) if ((ctx)->profile != NULL) profileRet((ctx)->profile)
+#else
+#define PROFILE_STEP(ctx, instr)
+#define PROFILE_CALL(ctx, instr)
+#define PROFILE_RET(ctx)
+#endif
+
+//-DASM_MEMO builds call memoization into the switch engine, see executeMemoized. without it the hooks are empty.
+#ifdef ASM_MEMO
+#define MEMO_RECALL(ctx, instr) ((ctx)->memo != NULL && recallCall((ctx)->memo, (ctx), (instr)))
+#define MEMO_RET(ctx) if ((ctx)->memo != NULL) finishCall((ctx)->memo, (ctx))
+#else
+#define MEMO_RECALL(ctx, instr) 0
+#define MEMO_RET(ctx)
+#endif
+#define MEMO_BUCKETS 64
+#define MEMO_CAPACITY (16 << 20)
+
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_BRANCH_MISSES 2
+#define COUNTER_L1D_MISSES 3
+#define COUNTER_LLC_MISSES 4
+#define NUM_COUNTERS 5
+
+//computed goto is a GNU extension, other compilers always get the switch engine.
+#if defined(__GNUC__)
+#define HAVE_THREADED 1
+#else
+#define HAVE_THREADED 0
+#endif
+
+//the template JIT emits x86-64 for the System V ABI, -DNO_JIT keeps every program on the interpreters.
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN32) && !defined(NO_JIT)
+#define HAVE_JIT 1
+#else
+#define HAVE_JIT 0
+#endif
+
+//gcc merges the identical dispatch tails of the handlers back into one indirect jump unless told not to.
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_TAIL_MERGE __attribute__((optimize("no-crossjumping", "no-gcse")))
+#else
+#define NO_TAIL_MERGE
+#endif
+
+//a batch worker's share of the input is a [begin, end) range packed into one word, so owner and thieves
+//can both claim from it with a single compare and swap.
+#define RANGE(begin, end) (((unsigned long long)(unsigned)(end) << 32) | (unsigned)(begin))
+#define RANGE_BEGIN(range) ((int)((range) & 0xFFFFFFFFu))
+#define RANGE_END(range) ((int)((range) >> 32))
+
+//a run is charged the instructions it executed whenever it changes course, and yields at the first change of
+//course after its fuel runs out. resumeRun returns one of the RUN_ states.
+#define FUEL_UNLIMITED LLONG_MAX
+#define RUN_DONE 0
+#define RUN_YIELDED 1
+#define RUN_FAILED -1
+#define SCHEDULER_QUANTUM 10000
+
+//the vector scanners read whole aligned blocks. a block can run past the terminating '\0' but never into the
+//next page, so those reads are safe even though the address sanitizer would flag them.
+#if LEXER_VECTOR == 32
+#define VECTOR __m256i
+#define VECTOR_LOAD(p) _mm256_load_si256((const __m256i*)(p))
+#define VECTOR_HAS(v, c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define VECTOR_OR(a, b) _mm256_or_si256(a, b)
+#define VECTOR_MASK(v) ((unsigned)_mm256_movemask_epi8(v))
+#elif LEXER_VECTOR == 16
+#define VECTOR __m128i
+#define VECTOR_LOAD(p) _mm_load_si128((const __m128i*)(p))
+#define VECTOR_HAS(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define VECTOR_OR(a, b) _mm_or_si128(a, b)
+#define VECTOR_MASK(v) ((unsigned)_mm_movemask_epi8(v))
+#endif
+
+//executeLanes runs LANES register sets at once in vectors of the same width, one int per lane. a lane mask has
+//every bit of the lanes it selects set, LANES_SELECT takes a where the mask is set and b everywhere else.
+#if LEXER_VECTOR == 32
+#define LANES 8
+#define Lanes __m256i
+#define LANES_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define LANES_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define LANES_SET(x) _mm256_set1_epi32(x)
+#define LANES_ADD(a, b) _mm256_add_epi32(a, b)
+#define LANES_SUB(a, b) _mm256_sub_epi32(a, b)
+#define LANES_MUL(a, b) _mm256_mullo_epi32(a, b)
+#define LANES_EQUAL(a, b) _mm256_cmpeq_epi32(a, b)
+#define LANES_GREATER(a, b) _mm256_cmpgt_epi32(a, b)
+#define LANES_AND(a, b) _mm256_and_si256(a, b)
+#define LANES_AND_NOT(a, b) _mm256_andnot_si256(a, b)
+#define LANES_SELECT(mask, a, b) _mm256_blendv_epi8(b, a, mask)
+#define LANES_SHORT(v) _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16)
+#define LANES_BITS(v) ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(v)))
+#define LANES_MASK(bits) _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), \
+    _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128))
+#elif LEXER_VECTOR == 16
+#define LANES 4
+#define Lanes __m128i
+#define LANES_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define LANES_STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define LANES_SET(x) _mm_set1_epi32(x)
+#define LANES_ADD(a, b) _mm_add_epi32(a, b)
+#define LANES_SUB(a, b) _mm_sub_epi32(a, b)
+#define LANES_MUL(a, b) multiplyLanes(a, b)
+#define LANES_EQUAL(a, b) _mm_cmpeq_epi32(a, b)
+#define LANES_GREATER(a, b) _mm_cmpgt_epi32(a, b)
+#define LANES_AND(a, b) _mm_and_si128(a, b)
+#define LANES_AND_NOT(a, b) _mm_andnot_si128(a, b)
+#define LANES_SELECT(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+#define LANES_SHORT(v) _mm_srai_epi32(_mm_slli_epi32(v, 16), 16)
+#define LANES_BITS(v) ((unsigned)_mm_movemask_ps(_mm_castsi128_ps(v)))
+#define LANES_MASK(bits) _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), _mm_setr_epi32(1, 2, 4, 8)), \
+    _mm_setr_epi32(1, 2, 4, 8))
+
+//sse2 has no 32 bit multiply that keeps the low half, so the even and odd lanes go through the 64 bit one.
+static inline __m128i multiplyLanes(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#else
+#define LANES 1
+#define Lanes int
+#define LANES_LOAD(p) (*(p))
+#define LANES_STORE(p, v) (*(p) = (v))
+#define LANES_SET(x) (x)
+#define LANES_ADD(a, b) ((int)((unsigned)(a) + (unsigned)(b)))
+#define LANES_SUB(a, b) ((int)((unsigned)(a) - (unsigned)(b)))
+#define LANES_MUL(a, b) ((int)((unsigned)(a) * (unsigned)(b)))
+#define LANES_EQUAL(a, b) (-((a) == (b)))
+#define LANES_GREATER(a, b) (-((a) > (b)))
+#define LANES_AND(a, b) ((a) & (b))
+#define LANES_AND_NOT(a, b) (~(a) & (b))
+#define LANES_SELECT(mask, a, b) ((mask) ? (a) : (b))
+#define LANES_SHORT(v) ((short)(v))
+#define LANES_BITS(v) ((unsigned)(v) & 1u)
+#define LANES_MASK(bits) (-(int)((bits) & 1u))
+#endif
+
+#if defined(__GNUC__)
+#define NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE
+#endif
 
-#define INVALID_CHAR (*program == ' ' || *program == ';' || *program == '\n' || *program == '\t')
-#define INVALID_CHAR_DP (**program == ' ' || **program == ';' || **program == '\n' || **program == '\t')
+//perfect hash of the mnemonics in operations[], no two of them share a slot of opcodeTable.
+#define OPCODE_HASH(s, len) (((unsigned)(s)[0] + (unsigned)(s)[1] + (unsigned)(s)[(len) - 1] * 10 + (len)) & 63)
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+#define ENDS_WORD(c) ((c) == ' ' || (c) == '\t' || (c) == ',' || (c) == ';' || (c) == '\n' || (c) == '\0')
 
 struct instruction {
     short opcode;
@@ -42,192 +326,1596 @@ struct instruction {
     char fromRegister;
     
     char lbl[MAX_LBL]; 
-    char message[MAX_MSG];
-    char code[MAX_CODE_LEN];
+    const char* message;
+    int messageLength;
   
     int compareX;
     int compareY;
+
+    int target;
     
 };
 typedef struct instruction Instruction;
 
+//a subroutine is a contiguous run of the lexer's token stream.
 struct function {
     char lbl[MAX_LBL];
+    int start;
     int numRoutines;
-    Instruction subroutine[10];
+    Instruction* subroutine;
 };
 typedef struct function Function;
 
-int registers[26] = {0};
-short cmpX;
-short cmpY;
-short comparator;
-short validEnd = 1;
-char msg[MAX_MSG] = {0};
-char* formattedMsg;
+//memory handed out by an arena is only ever released all at once, by arenaFree.
+struct arenaBlock {
+    struct arenaBlock* next;
+    size_t used;
+    size_t size;
+    _Alignas(16) char data[];
+};
+typedef struct arenaBlock ArenaBlock;
+
+struct arena {
+    ArenaBlock* blocks;
+};
+typedef struct arena Arena;
+
+//packed form of an instruction that the executor runs on. registers are indices, jump and call targets are code indices
+//and the text of a msg lives in the program's message table. fused is the second opcode of a superinstruction.
+struct bytecode {
+    unsigned char opcode;
+    unsigned char toRegister;
+    unsigned char fromRegister;
+    unsigned char fused;
+
+    int value;
+    int operand;
+    int target;
+};
+typedef struct bytecode Bytecode;
+
+//one piece of a msg as the encoder laid it out: length bytes of the text pool starting at offset, or the
+//value of register reg when reg is not NO_REG.
+struct msgSegment {
+    int offset;
+    int length;
+    int reg;
+};
+typedef struct msgSegment MsgSegment;
+
+//the encoded program: the main stream followed by every subroutine, each stream closed by a ret.
+struct program {
+    Bytecode* code;
+    int numCode;
+
+    int* entries;
+    int numEntries;
+    //labels of the subroutines at entries, for reports. a loaded image has none.
+    char (*names)[MAX_LBL];
+
+    //message i is segments[messages[i]] up to segments[messages[i + 1]].
+    int* messages;
+    int numMessages;
+    MsgSegment* segments;
+    int numSegments;
+    char* text;
+    int textSize;
+
+    int engine;
+    int maxDepth;
+    const void** handlers;
+    void* native;
+    size_t nativeSize;
+
+    void* image;
+    size_t imageSize;
+
+    Arena arena;
+};
+typedef struct program Program;
+
+//what the lexer, linker and encoder need while turning source text into a Program. all of it comes from
+//the compiler's own arena, which is dropped as soon as the program is encoded.
+struct compiler {
+    Instruction* tokens;
+    int numTokens;
+    int maxTokens;
+
+    Function* functions;
+    int numFunctions;
+    int maxFunctions;
+    Program* program;
+
+    int maxSegments;
+    int maxText;
+
+    Arena arena;
+};
+typedef struct compiler Compiler;
+
+//text of the last msg, kept null terminated. it only ever grows, so a run reuses one allocation.
+struct outputBuffer {
+    char* data;
+    int length;
+    int capacity;
+};
+typedef struct outputBuffer OutputBuffer;
+
+//where a streaming run sends every msg, each one followed by a newline. output is gathered into a block of
+//fixed size and handed to write, or to fd when write is NULL, only when the block fills or on flushSink.
+//write returns the number of bytes it took, anything short of length counts as a failure.
+typedef long (*SinkWrite)(void* user, const char* data, int length);
+
+struct outputSink {
+    SinkWrite write;
+    void* user;
+    int fd;
+
+    char* block;
+    int length;
+    int capacity;
+    int failed;
+};
+typedef struct outputSink OutputSink;
+
+//everything one interpreter run reads or writes. the program is only read, so any number of contexts on
+//separate threads can run the same compiled program.
+struct context {
+    int registers[26];
+    short cmpX;
+    short cmpY;
+    short comparator;
+    short validEnd;
+    OutputBuffer output;
+    OutputSink* sink;
+#ifdef ASM_PROFILE
+    struct profile* profile;
+#endif
+#ifdef ASM_MEMO
+    struct memo* memo;
+#endif
+
+    //return addresses of the interpreters, as code indices. grown on demand up to maxDepth.
+    int* returnStack;
+    int depth;
+    int maxDepth;
+    int stackCapacity;
+
+    //where a yielded run resumes, a code index, and what it has left to spend before it yields again.
+    int pc;
+    int status;
+    long long fuel;
+
+    const Program* program;
+};
+typedef struct context Context;
+
+//the register sets executeLanes runs together. registers are kept a register at a time across the lanes, cmpX
+//and cmpY already truncated to short, and each lane has a context of its own for its return stack, its output
+//and whether it failed. lanes at the same pc step together, running has a bit for every lane not yet done.
+struct laneGroup {
+    int registers[26][LANES];
+    int cmpX[LANES];
+    int cmpY[LANES];
+    int pc[LANES];
+    unsigned running;
+    Context lanes[LANES];
+};
+typedef struct laneGroup LaneGroup;
+
+//the stack native code runs on, one per thread. size covers the whole mapping, guard page included, see nativeStack.
+struct nativeStack {
+    char* memory;
+    size_t size;
+};
+typedef struct nativeStack NativeStack;
+
+pthread_key_t nativeStackKey;
+pthread_once_t nativeStackOnce = PTHREAD_ONCE_INIT;
+
+//what a stream does to the registers, with everything it calls or jumps to included. reads are the registers it
+//can read before writing them, writes those it may write and always those it writes on every path that
+//returns. accumulated are the registers it only ever adds to or subtracts from, never reading them otherwise,
+//so what they end up with is what they started with plus an amount that does not depend on them. FLOW_CMP
+//stands for the comparison. a pure stream never reaches a msg.
+struct streamSummary {
+    unsigned reads;
+    unsigned writes;
+    unsigned always;
+    unsigned accumulated;
+    int pure;
+};
+typedef struct streamSummary StreamSummary;
+
+#ifdef ASM_MEMO
+//a finished call of a pure stream: the values of its key when it was called, then the values it left in the
+//other registers it may write, then how much it added to each accumulated register. peak is how many calls
+//deep it went, itself included.
+struct memoRecord {
+    struct memoRecord* next;
+    unsigned hash;
+    int stream;
+    int peak;
+    int values[];
+};
+typedef struct memoRecord MemoRecord;
+
+//a call being recorded, with its key and then its accumulated registers as they were when it was made. base is
+//the depth it was made at, peak the deepest depth reached under it so far.
+struct memoFrame {
+    int stream;
+    int base;
+    int peak;
+    int values[28];
+};
+typedef struct memoFrame MemoFrame;
+
+//calls of pure streams remembered over every run made with executeMemoized. a call is keyed on the stream and
+//the registers it reads or may leave as they were, accumulators aside. a hit sets the registers it may write,
+//adds to the accumulators and skips the call. when the records would take more than capacity bytes the table
+//starts over.
+struct memo {
+    const Program* program;
+    StreamSummary* summaries;
+    int* streamAt;
+
+    MemoRecord** buckets;
+    int numBuckets;
+    int numRecords;
+    Arena records;
+    size_t capacity;
+    size_t used;
+
+    MemoFrame* frames;
+    int numFrames;
+    int maxFrames;
+
+    long long hits;
+    long long misses;
+    long long resets;
+
+    Arena arena;
+};
+typedef struct memo Memo;
+#endif
+
+#ifdef ASM_COUNTERS
+//hardware counters summed over every phase measured between openCounters and closeCounters. a counter that
+//could not be opened has fd -1 and reads as -1, time is always measured.
+struct counters {
+    int fds[NUM_COUNTERS];
+    long long values[NUM_COUNTERS];
+    long long time;
+    long long start;
+    int runs;
+};
+typedef struct counters Counters;
+#endif
+
+#ifdef ASM_PROFILE
+//one calling context: a subroutine reached through one chain of calls. recursion folds onto the frame it
+//recurses into, so the tree never gets deeper than the number of subroutines.
+struct profileNode {
+    int stream;
+    int parent;
+    int firstChild;
+    int nextSibling;
+    long long calls;
+    long long selfTime;
+};
+typedef struct profileNode ProfileNode;
+
+struct profileFrame {
+    int node;
+    long long start;
+    long long childTime;
+};
+typedef struct profileFrame ProfileFrame;
+
+//counts of every run of a program made with executeProfiled. streams are numbered like the data-flow pass does,
+//0 is the main stream and f + 1 the subroutine at entries[f]. times are in nanoseconds.
+struct profile {
+    const Program* program;
+    long long* counts;
+    long long* taken;
+    long long* notTaken;
+
+    long long* streamCalls;
+    long long* inclusiveTime;
+    int* active;
+    int numStreams;
+
+    ProfileNode* nodes;
+    int numNodes;
+    int maxNodes;
+    ProfileFrame* frames;
+    int numFrames;
+    int maxFrames;
+    const Bytecode* last;
+    int failed;
+
+    Arena arena;
+};
+typedef struct profile Profile;
+#endif
+
+//header of an on-disk program image. the code, entry, message, segment and text tables follow at the given offsets,
+//laid out exactly as Program points at them, so a mapped image runs in place.
+struct imageHeader {
+    unsigned int magic;
+    unsigned int version;
+
+    int numCode;
+    int numEntries;
+    int numMessages;
+    int numSegments;
+    int textSize;
+
+    int codeOffset;
+    int entriesOffset;
+    int messagesOffset;
+    int segmentsOffset;
+    int textOffset;
+};
+typedef struct imageHeader ImageHeader;
+
+//one per batch worker, aligned so the owner and thieves of different queues never share a cache line.
+struct workQueue {
+    _Alignas(64) _Atomic unsigned long long range;
+};
+typedef struct workQueue WorkQueue;
+
+struct batch {
+    const char** programs;
+    char** results;
+    WorkQueue* queues;
+    int numWorkers;
+};
+typedef struct batch Batch;
+
+//machine code under construction. fixups lists the rel32 fields that still hold a code index
+//instead of a displacement.
+struct jit {
+    unsigned char* code;
+    int size;
+    int capacity;
+
+    int* fixups;
+    int numFixups;
+    int maxFixups;
+
+    int failed;
+    Arena arena;
+};
+typedef struct jit Jit;
+
+//what the data-flow pass knows about the machine at one point of a stream: the set of registers, and the
+//comparison, whose value is a compile time constant.
+struct flowState {
+    unsigned known;
+    int values[26];
+    short cmpX;
+    short cmpY;
+};
+typedef struct flowState FlowState;
+
+//the control-flow graph of an encoded program. jumps and calls only ever target a stream entry, so every stream
+//is one straight line with side exits and the streams themselves are the nodes.
+struct flowGraph {
+    int numStreams;
+    int* start;
+    int* end;
+    int* streamOf;
+    unsigned* liveIn;
+    char* reachable;
+    char* dead;
+    int seeded;
+};
+typedef struct flowGraph FlowGraph;
+
+struct batchWorker {
+    Batch* batch;
+    int id;
+    pthread_t thread;
+};
+typedef struct batchWorker BatchWorker;
+
+//one program in flight on a scheduler. fuel is what it may still spend in total, result is set once it finishes.
+struct job {
+    Context* ctx;
+    long long fuel;
+    char* result;
+    int finished;
+};
+typedef struct job Job;
+
+//runs any number of programs on a few threads. each job runs for one quantum at a time and then goes to the back
+//of the queue, so a long or endless program holds the others up by at most one quantum per turn.
+struct scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t finished;
+
+    Job** queue;
+    int head;
+    int count;
+    int capacity;
+
+    long long quantum;
+    int stopping;
+    pthread_t* threads;
+    int numThreads;
+};
+typedef struct scheduler Scheduler;
+
+//an interpreter kept for reuse. between runs it holds on to its arenas, output buffer and return stack, and a
+//run only rewinds them, so once they have grown to fit what it runs it makes no allocations at all.
+struct interpreter {
+    Arena scratch;
+    Arena storage;
+    OutputBuffer output;
+    int* returnStack;
+    int stackCapacity;
+    struct interpreter* next;
+};
+typedef struct interpreter Interpreter;
+
+//the idle interpreters, shared by every thread.
+struct interpreterPool {
+    pthread_mutex_t lock;
+    Interpreter* idle;
+};
+typedef struct interpreterPool InterpreterPool;
+
 const char* operations[] = {"mov", "inc", "dec", "add", "sub", "mul", "div", "label:", "jmp", "cmp", "jne", "je", "jge", "jg", "jle", "jl", "call", "ret", "msg", "end"};
-Function functions[10];
-int numFunctions = 0;
+const signed char opcodeTable[64] = {
+    CLL, -1, -1, JE, -1, -1, JGE, -1, -1, -1, -1, JLE, -1, JNE, -1, -1,
+    JL, -1, -1, -1, -1, -1, -1, LBL, -1, JG, -1, -1, -1, MUL, -1, -1,
+    -1, -1, RET, -1, -1, -1, -1, -1, -1, MSG, DEC, -1, DIV, -1, -1, -1,
+    ADD, -1, -1, CMP, -1, -1, -1, -1, INC, -1, JMP, MOV, -1, -1, END, SUB
+};
 
-Instruction* createInstr() {
-    Instruction* instr = calloc(1, sizeof(Instruction));
+void resetInstr(Instruction* instr) {
+    memset(instr, 0, sizeof(Instruction));
     instr->opcode = -1;
-    return instr;
+    instr->target = -1;
+}
+
+//hands out zeroed, 16 byte aligned memory from the newest block, starting a bigger block when it runs out.
+//NULL when that block can not be had, the arena is then left as it was.
+void* arenaAlloc(Arena* arena, size_t size) {
+    ArenaBlock* block = arena->blocks;
+    void* memory;
+
+    size = (size + 15) & ~(size_t)15;
+    if (block == NULL || block->used + size > block->size) {
+        size_t blockSize = block == NULL ? ARENA_BLOCK : block->size * 2;
+
+        if (blockSize > ARENA_MAX_BLOCK) blockSize = ARENA_MAX_BLOCK;
+        if (blockSize < size) blockSize = size;
+        block = malloc(sizeof(ArenaBlock) + blockSize);
+        if (block == NULL) return NULL;
+        block->next = arena->blocks;
+        block->used = 0;
+        block->size = blockSize;
+        arena->blocks = block;
+    }
+
+    memory = block->data + block->used;
+    block->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+//resizes the most recent allocation in place when it is still at the top of its block, otherwise moves it.
+void* arenaGrow(Arena* arena, void* old, size_t oldSize, size_t newSize) {
+    ArenaBlock* block = arena->blocks;
+    size_t oldAligned = (oldSize + 15) & ~(size_t)15;
+    size_t newAligned = (newSize + 15) & ~(size_t)15;
+    void* memory;
+
+    if (old != NULL && (char*)old + oldAligned == block->data + block->used &&
+        block->used - oldAligned + newAligned <= block->size) {
+        block->used += newAligned - oldAligned;
+        memset((char*)old + oldSize, 0, newAligned - oldSize);
+        return old;
+    }
+
+    memory = arenaAlloc(arena, newSize);
+    if (memory != NULL && old != NULL) memcpy(memory, old, oldSize);
+    return memory;
+}
+
+//makes room for element number count of an arena array, doubling its capacity when it is full. NULL when out
+//of memory, the capacity is then left alone.
+void* growArray(Arena* arena, void* array, int* capacity, int count, size_t size) {
+    int newCapacity = *capacity;
+
+    if (count < *capacity) return array;
+    while (newCapacity <= count) newCapacity = newCapacity == 0 ? MIN_CAPACITY : newCapacity * 2;
+
+    array = arenaGrow(arena, array, *capacity * size, newCapacity * size);
+    if (array != NULL) *capacity = newCapacity;
+    return array;
+}
+
+void arenaFree(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+//empties an arena but keeps its memory, what it hands out next is zeroed as it goes. an arena that needed more
+//than one block gets a single block as large as all of them, so the same use fits without allocating again.
+void arenaReset(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    size_t size = 0;
+
+    if (block == NULL) return;
+    if (block->next == NULL) {
+        block->used = 0;
+        return;
+    }
+    for (; block != NULL; block = block->next) size += block->size;
+    arenaFree(arena);
+    block = malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL) return;
+    block->next = NULL;
+    block->used = 0;
+    block->size = size;
+    arena->blocks = block;
 }
 
 //function prototypes
-void printRegisters(void);
+void* arenaAlloc(Arena* arena, size_t size);
+void* arenaGrow(Arena* arena, void* old, size_t oldSize, size_t newSize);
+void* growArray(Arena* arena, void* array, int* capacity, int count, size_t size);
+void arenaFree(Arena* arena);
+void arenaReset(Arena* arena);
+char* assembler_interpreter(const char* program);
+char** assembler_interpreter_batch(const char** programs, int numPrograms);
+Program* compileProgram(const char* source);
+Program* compileWithOptions(const char* source, int options);
+Program* compileTimed(const char* source, int options, long long* phaseTimes);
+Program* compileInto(const char* source, int options, long long* phaseTimes, Arena* scratch, Arena* storage);
+long long monotonicNow(void);
+Program* compileFile(const char* path);
+char* executeProgram(const Program* pgm);
+char* executeToSink(const Program* pgm, OutputSink* sink);
+OutputSink* openSink(SinkWrite write, void* user, int blockSize);
+OutputSink* openFdSink(int fd, int blockSize);
+int flushSink(OutputSink* sink);
+int closeSink(OutputSink* sink);
+char* runContext(Context* ctx);
+char* executeFrom(const Program* pgm, const int registers[26]);
+char** executeLanes(const Program* pgm, const int (*registers)[26], int count);
+Context* openRun(const Program* pgm);
+int resumeRun(Context* ctx, long long fuel);
+char* closeRun(Context* ctx);
+void setCallDepth(Program* pgm, int depth);
+int saveProgram(const Program* pgm, const char* path);
+Program* loadProgram(const char* path);
+int verifyProgram(const Program* pgm);
+int setEngine(Program* pgm, int engine);
+int takeWork(WorkQueue* queue);
+int stealWork(WorkQueue* victim, WorkQueue* thief);
+void* batchWorker(void* arg);
+Scheduler* openScheduler(int numThreads, long long quantum);
+void closeScheduler(Scheduler* sched);
+Job* submitJob(Scheduler* sched, const Program* pgm, long long fuel);
+char* waitJob(Scheduler* sched, Job* job);
+int queueJob(Scheduler* sched, Job* job);
+void* schedulerWorker(void* arg);
+InterpreterPool* openPool(void);
+void closePool(InterpreterPool* pool);
+Interpreter* acquireInterpreter(InterpreterPool* pool);
+void releaseInterpreter(InterpreterPool* pool, Interpreter* interp);
+const char* interpret(Interpreter* interp, const char* source);
+void printRegisters(Context* ctx);
+NO_SANITIZE unsigned wordMask(const char* block);
+NO_SANITIZE unsigned lineMask(const char* block);
+NO_SANITIZE const char* scanWord(const char* program);
+NO_SANITIZE const char* scanLine(const char* program);
+void copyWord(const char** program, char* string, int size);
 void removeComment(const char** program);
 void trimLine(const char** program);
 void printTokens(Instruction* token, int numTokens);
-void printFunctions(Function* function);
+void printFunctions(Compiler* comp);
 void parseOpcode(char* string, Instruction* instr);
 void parseMov(const char** program, Instruction* instr);
 void parseMath(const char** program, Instruction* instr);
 void parseJmp(const char** program, Instruction* instr);
 void parseMsg(const char** program, Instruction* instr);
 void parseEnd(void);
-void parseLbl(const char** program, char* string, Function* functions);
+int parseLbl(const char** program, char* string, Compiler* comp, int* current);
 void parseCall(const char** program, Instruction* instr);
 void parseCmp(const char** program, Instruction* instr);
 void parseRet(Instruction* instr);
-void lexer(const char* program, Instruction* tokenizedProgram, int* numTokens, Function* functions);
-void executeMathOp(Instruction* instr);
-void executeCall(Instruction* instr);
-void executeCmp(Instruction* instr);
-void executeJmp(Instruction** instr, int* pgmCounter);
-void executor(Instruction* tokenizedProgram, int* numTokens);
+void closeFunction(Compiler* comp, int* current);
+int lexer(const char* program, Compiler* comp);
+int linkLabel(Instruction* instr, Compiler* comp);
+int linker(Compiler* comp);
+int encodeRegister(char name, unsigned char* index);
+int addSegment(Compiler* comp, int reg, const char* text, int length);
+int encodeMessage(Compiler* comp, const char* text, int length);
+int encodeInstr(Instruction* instr, Bytecode* bc, Compiler* comp, int last);
+int encoder(Compiler* comp);
+int inlineBody(const Program* pgm, int entry, int end);
+void inlineProgram(Program* pgm);
+int foldMath(int opcode, int left, int right, int* result);
+unsigned messageUses(const Program* pgm, int message);
+void propagateStream(Program* pgm, FlowGraph* graph, int stream);
+unsigned streamLiveness(const Program* pgm, FlowGraph* graph, int stream, int apply);
+void optimizeProgram(Program* pgm, int options);
+int summarizeStreams(const Program* pgm, StreamSummary* summaries);
+int baseOpcode(int opcode);
+void fuseProgram(Program* pgm);
+void freeProgram(Program* pgm);
+void executeMov(Context* ctx, Bytecode* instr);
+void executeMathOp(Context* ctx, Bytecode* instr);
+int pushReturn(Context* ctx, int pc);
+int executeCall(Context* ctx, Bytecode** instr);
+int executeRet(Context* ctx, Bytecode** instr);
+void executeCmp(Context* ctx, Bytecode* instr);
+void executeJmp(Context* ctx, Bytecode** instr);
+int branchTaken(const Context* ctx, int opcode);
+void executeFused(Context* ctx, Bytecode** instr);
+int reserveOutput(OutputBuffer* out, int size);
+void appendText(OutputBuffer* out, const char* text, int length);
+void appendInt(OutputBuffer* out, int value);
+void sinkWrite(OutputSink* sink, const char* data, int length);
+void sinkAppend(OutputSink* sink, const char* data, int length);
+void executeMsg(Context* ctx, int message);
+void executor(Context* ctx, Bytecode* entry);
+NO_TAIL_MERGE void threadedExecutor(Context* ctx, const Program* pgm, int entry);
+void emitBytes(Jit* jit, const char* bytes, int size);
+void emitInt(Jit* jit, int value);
+void emitTarget(Jit* jit, int target);
+int jitCompile(Program* pgm);
+void loadEngine(Program* pgm, int native);
+void freeNativeStack(void* stack);
+void createNativeStackKey(void);
+char* nativeStack(size_t size);
+void runProgram(Context* ctx);
+void translateText(FILE* out, const char* text, int length);
+void translateOperand(FILE* out, int reg, int value);
+int translateProgram(const Program* pgm, const char* symbol, FILE* out);
+Lanes laneOperand(LaneGroup* group, int reg, int value);
+void failLane(LaneGroup* group, int lane);
+void runLanes(LaneGroup* group, const Program* pgm);
+#ifdef ASM_PROFILE
+Profile* openProfile(const Program* pgm);
+void closeProfile(Profile* profile);
+char* executeProfiled(const Program* pgm, Profile* profile);
+int streamOf(const Program* pgm, int pc);
+const char* streamName(const Program* pgm, int stream, char* buffer);
+const char* opcodeName(int opcode);
+void profileStep(Profile* profile, const Context* ctx, const Bytecode* instr);
+void profileCall(Profile* profile, const Bytecode* instr);
+void profileRet(Profile* profile);
+void printProfile(const Profile* profile, FILE* out);
+void printStack(const Profile* profile, int node, FILE* out);
+void printCollapsedStacks(const Profile* profile, FILE* out);
+#endif
+#ifdef ASM_MEMO
+Memo* openMemo(const Program* pgm, size_t capacity);
+void closeMemo(Memo* memo);
+char* executeMemoized(const Program* pgm, Memo* memo);
+int gatherValues(const Context* ctx, unsigned set, int* values);
+int scatterValues(Context* ctx, unsigned set, const int* values);
+int countValues(unsigned set);
+unsigned memoKey(const StreamSummary* summary);
+unsigned hashValues(int stream, const int* values, int count);
+void resetMemo(Memo* memo);
+void rememberCall(Memo* memo, const MemoFrame* frame, const Context* ctx);
+int recallCall(Memo* memo, Context* ctx, const Bytecode* instr);
+void finishCall(Memo* memo, Context* ctx);
+#endif
+#ifdef ASM_COUNTERS
+void openCounters(Counters* counters);
+void closeCounters(Counters* counters);
+int countersAvailable(const Counters* counters);
+void startCounters(Counters* counters);
+void stopCounters(Counters* counters);
+char* measureRun(const char* source, Counters* lexPhase, Counters* executePhase);
+#endif
 
 //main program driver.
 char* assembler_interpreter (const char* program) {
+    Program* pgm = compileProgram(program);
+    char* result;
 
-    numFunctions = 0;
-    validEnd = 1;
-    memset(functions, 0, sizeof(Function) * 10);
-    memset(msg, 0, sizeof(char) * MAX_MSG);
-    memset(registers, 0, sizeof(int) * 26);
-       
-    Instruction* tokenizedProgram = calloc(50, sizeof(Instruction));
-    int numTokens = 0;
-    formattedMsg = calloc(MAX_MSG, sizeof(char));
-
-    lexer(program, tokenizedProgram, &numTokens, functions);
-      
-    executor(tokenizedProgram, &numTokens);
-    free(tokenizedProgram);
+    if (pgm == NULL) return (char*) -1;
   
-    if (validEnd != -1) {
-        return formattedMsg;
+    result = executeProgram(pgm);
+    freeProgram(pgm);
+    return result;
+}
+
+//lexes, links and encodes a program once. returns NULL if the program can never run, the handle
+//can then be executed any number of times, from any number of threads at once.
+Program* compileProgram(const char* source) {
+    return compileWithOptions(source, OPTIMIZE_ALL);
+}
+
+//compileProgram with a choice of OPTIMIZE_ passes, mostly so their effect can be measured.
+Program* compileWithOptions(const char* source, int options) {
+    return compileTimed(source, options, NULL);
+}
+
+//compileWithOptions that also adds the nanoseconds each PHASE_ took to phaseTimes, unless it is NULL.
+Program* compileTimed(const char* source, int options, long long* phaseTimes) {
+    Arena scratch = {0};
+    Arena storage = {0};
+    Program* pgm = compileInto(source, options, phaseTimes, &scratch, &storage);
+
+    arenaFree(&scratch);
+    if (pgm == NULL) arenaFree(&storage);
+    return pgm;
+}
+
+//the compiler proper, working in arenas the caller owns. the program is built in storage and takes it over, when
+//it fails to compile storage is handed back as it was left. scratch is handed back either way.
+Program* compileInto(const char* source, int options, long long* phaseTimes, Arena* scratch, Arena* storage) {
+    Compiler* comp = arenaAlloc(scratch, sizeof(Compiler));
+    Program* pgm = arenaAlloc(storage, sizeof(Program));
+    long long times[NUM_PHASES + 1] = {0};
+    int phase = 0;
+    int linked;
+
+    if (comp == NULL || pgm == NULL) return NULL;
+    if (phaseTimes != NULL) times[0] = monotonicNow();
+    comp->program = pgm;
+    comp->arena = *scratch;
+    pgm->arena = *storage;
+    storage->blocks = NULL;
+    linked = lexer(source, comp) != -1;
+    if (phaseTimes != NULL && linked) times[++phase] = monotonicNow();
+    linked = linked && linker(comp) != -1;
+    if (phaseTimes != NULL && linked) times[++phase] = monotonicNow();
+
+    if (!linked || encoder(comp) == -1) {
+        *storage = pgm->arena;
+        pgm = NULL;
+    } else {
+        if (options & OPTIMIZE_INLINE) inlineProgram(pgm);
+        if (options & OPTIMIZE_DATAFLOW) optimizeProgram(pgm, options);
+        if (options & OPTIMIZE_FUSE) fuseProgram(pgm);
+        if (phaseTimes != NULL) times[++phase] = monotonicNow();
+        loadEngine(pgm, (options & OPTIMIZE_JIT) != 0);
+        if (phaseTimes != NULL) times[++phase] = monotonicNow();
     }
   
-    return (char*) -1;
+    for (int i = 0; phaseTimes != NULL && i < phase; i++) phaseTimes[i] += times[i + 1] - times[i];
+    *scratch = comp->arena;
+    return pgm;
 }
 
+long long monotonicNow(void) {
+    struct timespec now;
 
-void printRegisters(void) {
-    for (int i = 0; i < 26; i++) {
-        printf("%d, ", registers[i]);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//how deep calls may nest before a run of the program stops with the (char*) -1 error.
+void setCallDepth(Program* pgm, int depth) {
+    pgm->maxDepth = depth;
+}
+
+//compiles a source file straight out of a read-only mapping of it. the mapping always reaches at least one byte
+//past the end of the file, and those bytes are zero, so the lexer finds the '\0' it stops at without a copy.
+Program* compileFile(const char* path) {
+    struct stat info;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t length;
+    char* source;
+    Program* pgm;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) return NULL;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        return NULL;
     }
+
+    length = ((size_t)info.st_size / pageSize + 1) * pageSize;
+    source = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (source != MAP_FAILED && info.st_size > 0 &&
+        mmap(source, info.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(source, length);
+        source = MAP_FAILED;
+    }
+    close(fd);
+    if (source == MAP_FAILED) return NULL;
+
+    pgm = compileProgram(source);
+    munmap(source, length);
+    return pgm;
 }
 
-//admin functions to clean newlines, blank spaces, unused characters.
-void removeComment(const char** program) {
-    while (**program != '\0' && **program != '\n') (*program)++;
+//runs a compiled program on a fresh context. the result follows the assembler_interpreter contract.
+char* executeProgram(const Program* pgm) {
+    return executeToSink(pgm, NULL);
 }
 
-void trimLine(const char** program) {
-    while (INVALID_CHAR_DP) {
-        if (**program == ';') {
-            removeComment(program);
-            return;
-        }
-        (*program)++;
-    }    
+//runs a compiled program and streams every msg to sink as well, the sink is flushed before it returns. the result
+//is still the last msg, or (char*) -1 when the program fails or the sink could not take all of its output.
+char* executeToSink(const Program* pgm, OutputSink* sink) {
+    Context ctx;
+
+    memset(&ctx, 0, sizeof(Context));
+    ctx.validEnd = 1;
+    ctx.program = pgm;
+    ctx.maxDepth = pgm->maxDepth;
+    ctx.sink = sink;
+    return runContext(&ctx);
 }
 
-//print the tokens produced by lexer to verify correct lexical analysis.
-void printTokens(Instruction* token, int numTokens) {
-    for (int i = 0; i < numTokens; i++, token++) {
-        printf("Opcode: %d\n"
-               "Opcode: %s\n"
-               "Value: %d\n"
-               "ToRegister: %c\n"
-               "FromRegister: %c\n"
-               "Label: %s\n"
-               "Code: %s\n"
-               "Msg: %s\n"
-               "//////////////////\n",
-               token->opcode,
-               token->opcodeString,
-               token->value,
-               token->toRegister,
-               token->fromRegister,
-               token->lbl,
-               token->code,
-               msg);
+//runs a program compiled with OPTIMIZE_SEEDED, or without OPTIMIZE_DATAFLOW, from the given registers instead of
+//zeroed ones. the result follows the assembler_interpreter contract.
+char* executeFrom(const Program* pgm, const int registers[26]) {
+    Context ctx;
+
+    memset(&ctx, 0, sizeof(Context));
+    memcpy(ctx.registers, registers, sizeof(ctx.registers));
+    ctx.validEnd = 1;
+    ctx.program = pgm;
+    ctx.maxDepth = pgm->maxDepth;
+    return runContext(&ctx);
+}
+
+//executeFrom for count register sets at once, LANES of them in step on the vector unit. result i is exactly what
+//executeFrom would return for registers[i]. the array is malloc'd, NULL when out of memory.
+char** executeLanes(const Program* pgm, const int (*registers)[26], int count) {
+    char** results = malloc((count > 0 ? count : 1) * sizeof(char*));
+    LaneGroup* group = malloc(sizeof(LaneGroup));
+
+    if (results == NULL || group == NULL) {
+        free(results);
+        free(group);
+        return NULL;
+    }
+    for (int first = 0; first < count; first += LANES) {
+        int numLanes = count - first < LANES ? count - first : LANES;
+
+        memset(group, 0, sizeof(LaneGroup));
+        for (int l = 0; l < numLanes; l++) {
+            Context* lane = &group->lanes[l];
+
+            for (int r = 0; r < 26; r++) group->registers[r][l] = registers[first + l][r];
+            lane->validEnd = 1;
+            lane->program = pgm;
+            lane->maxDepth = pgm->maxDepth;
+            lane->output.data = calloc(MIN_OUTPUT, sizeof(char));
+            lane->output.capacity = lane->output.data != NULL ? MIN_OUTPUT : 0;
+            group->running |= 1u << l;
+        }
+
+        runLanes(group, pgm);
+        for (int l = 0; l < numLanes; l++) {
+            Context* lane = &group->lanes[l];
+
+            free(lane->returnStack);
+            if (lane->validEnd != -1 && lane->output.data != NULL) {
+                results[first + l] = lane->output.data;
+            } else {
+                free(lane->output.data);
+                results[first + l] = (char*) -1;
+            }
+        }
     }
+    free(group);
+    return results;
 }
 
-//print functions created by lexer to verify correct lexical analysis.
-void printFunctions(Function* func) {
+//runs a context set up by one of the execute functions and turns it into their result.
+char* runContext(Context* ctx) {
+    ctx->output.data = calloc(MIN_OUTPUT, sizeof(char));
+    ctx->output.capacity = ctx->output.data != NULL ? MIN_OUTPUT : 0;
+    ctx->fuel = FUEL_UNLIMITED;
+
+    runProgram(ctx);
+    free(ctx->returnStack);
+    if (ctx->sink != NULL && flushSink(ctx->sink) == -1) ctx->validEnd = -1;
   
-    for (int i = 0; i < numFunctions; func++, i++) {
-        printf("\nFunction Label: %s\n"
-               "Number of tokens: %d\n"
-               "Printing tokens:\n\n",
-               func->lbl, func->numRoutines);
-        printTokens(func->subroutine, func->numRoutines);
+    if (ctx->validEnd != -1 && ctx->output.data != NULL) {
+        return ctx->output.data;
     }
+    free(ctx->output.data);
+    return (char*) -1;
 }
 
-void printToken(Instruction* token) {
-    printf("Opcode: %d\n"
-               "Opcode: %s\n"
-               "Value: %d\n"
-               "ToRegister: %c\n"
-               "FromRegister: %c\n"
-               "Label: %s\n"
-               "Code: %s\n"
-               "Msg: %s\n"
-               "//////////////////\n",
-               token->opcode,
-               token->opcodeString,
-               token->value,
-               token->toRegister,
-               token->fromRegister,
-               token->lbl,
-               token->code,
-               msg);
+//a run of a compiled program that resumeRun advances a slice at a time, NULL when out of memory.
+Context* openRun(const Program* pgm) {
+    Context* ctx = calloc(1, sizeof(Context));
+
+    if (ctx == NULL) return NULL;
+    ctx->validEnd = 1;
+    ctx->program = pgm;
+    ctx->maxDepth = pgm->maxDepth;
+    ctx->status = RUN_YIELDED;
+    ctx->output.data = calloc(MIN_OUTPUT, sizeof(char));
+    ctx->output.capacity = MIN_OUTPUT;
+    if (ctx->output.data == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
 }
 
-//parses the opcode of the instruction and fills in the instruction data structure.
-void parseOpcode(char* string, Instruction* instr) {
-    for (int i = 0; i < NUM_OPS; i++) {
-        if (strcmp(string, operations[i]) == 0) {
-          instr->opcode = i;
-          strncpy(instr->opcodeString, operations[i], (size_t)MAX_LBL);
-          return;
-        }
+//runs until the program ends or has spent fuel instructions, 0 or less meaning no limit. a run can overshoot
+//its fuel by the straight-line stretch it was in, never by more. ctx->fuel is left holding what was not spent.
+int resumeRun(Context* ctx, long long fuel) {
+    if (ctx->status != RUN_YIELDED) return ctx->status;
+
+    ctx->fuel = fuel > 0 ? fuel : FUEL_UNLIMITED;
+    ctx->status = RUN_DONE;
+    runProgram(ctx);
+    if (ctx->validEnd == -1) ctx->status = RUN_FAILED;
+    return ctx->status;
+}
+
+//the result of a run with the assembler_interpreter contract, (char*) -1 as well for a run that never finished.
+char* closeRun(Context* ctx) {
+    char* result = ctx->output.data;
+
+    if (ctx->status != RUN_DONE) {
+        free(result);
+        result = (char*) -1;
     }
+    free(ctx->returnStack);
+    free(ctx);
+    return result;
 }
 
-//next parsing functions are called by the lexer once it verifies the opcode based on the rules.
-void parseMov(const char** program, Instruction* instr) {
-    char temp[MAX_LBL];
-    int currentValue = 0;
-    int negative = 1;
-    
-    instr->toRegister = **program;
-    (*program)++;
-    while (INVALID_CHAR_DP || **program == ',') (*program)++;
-  
-    if (**program == '-') {
-      negative = -1;
-      (*program)++;
+//a sink that hands its blocks to write. memory stays at one block however much the program prints.
+OutputSink* openSink(SinkWrite write, void* user, int blockSize) {
+    OutputSink* sink = calloc(1, sizeof(OutputSink));
+
+    if (sink == NULL) return NULL;
+    sink->write = write;
+    sink->user = user;
+    sink->fd = -1;
+    sink->capacity = blockSize > 0 ? blockSize : SINK_BLOCK;
+    sink->block = malloc(sink->capacity);
+    if (sink->block == NULL) {
+        free(sink);
+        return NULL;
     }
-  
-    for (int i = 0; i < MAX_LBL - 1 && !INVALID_CHAR_DP; i++, (*program)++) {
-        temp[i] = **program;
+    return sink;
+}
+
+//a sink that writes its blocks to a file descriptor, which stays open after closeSink.
+OutputSink* openFdSink(int fd, int blockSize) {
+    OutputSink* sink = openSink(NULL, NULL, blockSize);
+
+    if (sink != NULL) sink->fd = fd;
+    return sink;
+}
+
+//writes out whatever the block holds. -1 once any write has failed.
+int flushSink(OutputSink* sink) {
+    if (sink->length > 0) sinkWrite(sink, sink->block, sink->length);
+    sink->length = 0;
+    return sink->failed ? -1 : 0;
+}
+
+int closeSink(OutputSink* sink) {
+    int result;
+
+    if (sink == NULL) return 0;
+    result = flushSink(sink);
+    free(sink->block);
+    free(sink);
+    return result;
+}
+
+//writes a compiled program as an image that loadProgram can map and run without lexing it again.
+int saveProgram(const Program* pgm, const char* path) {
+    ImageHeader header;
+    FILE* file = fopen(path, "wb");
+    int written = 1;
+
+    if (file == NULL) return -1;
+
+    memset(&header, 0, sizeof(ImageHeader));
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.numCode = pgm->numCode;
+    header.numEntries = pgm->numEntries;
+    header.numMessages = pgm->numMessages;
+    header.numSegments = pgm->numSegments;
+    header.textSize = pgm->textSize;
+    header.codeOffset = sizeof(ImageHeader);
+    header.entriesOffset = header.codeOffset + pgm->numCode * sizeof(Bytecode);
+    header.messagesOffset = header.entriesOffset + pgm->numEntries * sizeof(int);
+    header.segmentsOffset = header.messagesOffset + (pgm->numMessages + 1) * sizeof(int);
+    header.textOffset = header.segmentsOffset + pgm->numSegments * sizeof(MsgSegment);
+
+    written &= fwrite(&header, sizeof(ImageHeader), 1, file) == 1;
+    written &= fwrite(pgm->code, sizeof(Bytecode), pgm->numCode, file) == (size_t)pgm->numCode;
+    written &= fwrite(pgm->entries, sizeof(int), pgm->numEntries, file) == (size_t)pgm->numEntries;
+    written &= fwrite(pgm->messages, sizeof(int), pgm->numMessages + 1, file) == (size_t)pgm->numMessages + 1;
+    written &= fwrite(pgm->segments, sizeof(MsgSegment), pgm->numSegments, file) == (size_t)pgm->numSegments;
+    written &= fwrite(pgm->text, 1, pgm->textSize, file) == (size_t)pgm->textSize;
+
+    if (fclose(file) != 0 || !written) return -1;
+    return 0;
+}
+
+//maps a program image read-only and points the program straight into it, nothing is parsed or copied.
+//the image is checked before it is used, so a corrupt or foreign file is refused instead of run.
+Program* loadProgram(const char* path) {
+    struct stat info;
+    const ImageHeader* header;
+    Program* pgm;
+    void* image;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) return NULL;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(ImageHeader)) {
+        close(fd);
+        return NULL;
+    }
+    image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return NULL;
+
+    header = image;
+    Arena storage = {0};
+    pgm = arenaAlloc(&storage, sizeof(Program));
+    if (pgm == NULL) {
+        munmap(image, info.st_size);
+        return NULL;
+    }
+    pgm->arena = storage;
+    pgm->image = image;
+    pgm->imageSize = info.st_size;
+
+    if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION ||
+        header->numCode < 1 || header->numEntries < 0 || header->numMessages < 0 ||
+        header->numSegments < 0 || header->textSize < 0 ||
+        header->codeOffset != sizeof(ImageHeader) ||
+        (size_t)header->entriesOffset != header->codeOffset + (size_t)header->numCode * sizeof(Bytecode) ||
+        (size_t)header->messagesOffset != header->entriesOffset + (size_t)header->numEntries * sizeof(int) ||
+        (size_t)header->segmentsOffset != header->messagesOffset + ((size_t)header->numMessages + 1) * sizeof(int) ||
+        (size_t)header->textOffset != header->segmentsOffset + (size_t)header->numSegments * sizeof(MsgSegment) ||
+        (size_t)header->textOffset + (size_t)header->textSize != pgm->imageSize) {
+        freeProgram(pgm);
+        return NULL;
+    }
+
+    pgm->code = (Bytecode*)((char*)image + header->codeOffset);
+    pgm->numCode = header->numCode;
+    pgm->entries = (int*)((char*)image + header->entriesOffset);
+    pgm->numEntries = header->numEntries;
+    pgm->messages = (int*)((char*)image + header->messagesOffset);
+    pgm->numMessages = header->numMessages;
+    pgm->segments = (MsgSegment*)((char*)image + header->segmentsOffset);
+    pgm->numSegments = header->numSegments;
+    pgm->text = (char*)image + header->textOffset;
+    pgm->textSize = header->textSize;
+
+    if (verifyProgram(pgm) == -1) {
+        freeProgram(pgm);
+        return NULL;
+    }
+    loadEngine(pgm, 0);
+    return pgm;
+}
+
+//checks that every opcode, register, target, message index and message segment of a program stays in bounds.
+int verifyProgram(const Program* pgm) {
+    const Bytecode* bc = pgm->code;
+
+    if (pgm->code[pgm->numCode - 1].opcode != RET) return -1;
+    for (int i = 0; i < pgm->numEntries; i++) {
+        if (pgm->entries[i] < 0 || pgm->entries[i] >= pgm->numCode) return -1;
+    }
+    for (int i = 0; i < pgm->numCode; i++, bc++) {
+        int op = baseOpcode(bc->opcode);
+
+        if (bc->opcode > MOVOP || bc->opcode == LBL) return -1;
+        if ((bc->toRegister >= 26 && bc->toRegister != NO_REG) || (bc->fromRegister >= 26 && bc->fromRegister != NO_REG)) return -1;
+        if (op <= DIV && bc->toRegister == NO_REG) return -1;
+        if ((op == JMP || op == CLL || IS_CONDITIONAL(op) || bc->opcode != op) && bc->opcode != MOVOP &&
+            (bc->target < 0 || bc->target >= pgm->numCode)) {
+            return -1;
+        }
+        if (op == MSG && (bc->operand < 0 || bc->operand >= pgm->numMessages)) return -1;
+
+        if (bc->opcode != op && i + FUSED_LENGTH(bc->opcode) >= pgm->numCode) return -1;
+        if ((bc->opcode == CMPJ || bc->opcode == INCJ || bc->opcode == DECJ) && !IS_CONDITIONAL(bc->fused)) return -1;
+        if (bc->opcode == MOVOP && bc->fused != ADD && bc->fused != SUB && bc->fused != MUL) return -1;
+    }
+    if (pgm->messages[0] != 0 || pgm->messages[pgm->numMessages] != pgm->numSegments) return -1;
+    for (int i = 0; i < pgm->numMessages; i++) {
+        if (pgm->messages[i + 1] < pgm->messages[i]) return -1;
+    }
+    for (int i = 0; i < pgm->numSegments; i++) {
+        const MsgSegment* segment = pgm->segments + i;
+
+        if (segment->reg != NO_REG && (segment->reg < 0 || segment->reg >= 26)) return -1;
+        if (segment->reg == NO_REG && (segment->offset < 0 || segment->length < 0 ||
+            segment->offset > pgm->textSize - segment->length)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//batch driver. runs every program on a pool of one worker per core and returns the results in input order,
+//each one exactly what assembler_interpreter would have returned for it, including the (char*) -1 error.
+//NULL when the batch itself cannot be set up.
+char** assembler_interpreter_batch(const char** programs, int numPrograms) {
+    Batch batch;
+    BatchWorker* workers;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t queueBytes;
+    int chunk;
+
+    batch.programs = programs;
+    batch.results = calloc(numPrograms + 1, sizeof(char*));
+    batch.numWorkers = cores < 1 ? 1 : cores > numPrograms ? (numPrograms > 0 ? numPrograms : 1) : (int)cores;
+    //aligned_alloc wants a size that is a multiple of the alignment.
+    queueBytes = (batch.numWorkers * sizeof(WorkQueue) + _Alignof(WorkQueue) - 1) / _Alignof(WorkQueue) * _Alignof(WorkQueue);
+    batch.queues = aligned_alloc(_Alignof(WorkQueue), queueBytes);
+    workers = calloc(batch.numWorkers, sizeof(BatchWorker));
+    if (batch.results == NULL || batch.queues == NULL || workers == NULL) {
+        free(batch.results);
+        free(batch.queues);
+        free(workers);
+        return NULL;
+    }
+
+    chunk = numPrograms / batch.numWorkers;
+    for (int i = 0; i < batch.numWorkers; i++) {
+        int end = i == batch.numWorkers - 1 ? numPrograms : (i + 1) * chunk;
+        atomic_init(&batch.queues[i].range, RANGE(i * chunk, end));
+        workers[i].batch = &batch;
+        workers[i].id = i;
+    }
+
+    //the calling thread is worker 0.
+    for (int i = 1; i < batch.numWorkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, batchWorker, &workers[i]) != 0) workers[i].batch = NULL;
+    }
+    batchWorker(&workers[0]);
+    for (int i = 1; i < batch.numWorkers; i++) {
+        if (workers[i].batch != NULL) pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+    free(batch.queues);
+    return batch.results;
+}
+
+//pops the next program index from the front of the worker's own range, -1 once the range is empty.
+int takeWork(WorkQueue* queue) {
+    unsigned long long range = atomic_load(&queue->range);
+
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        if (atomic_compare_exchange_weak(&queue->range, &range, RANGE(RANGE_BEGIN(range) + 1, RANGE_END(range)))) {
+            return RANGE_BEGIN(range);
+        }
+    }
+    return -1;
+}
+
+//moves the back half of the victim's range into the thief's empty queue. returns 0 if there was nothing left to take.
+int stealWork(WorkQueue* victim, WorkQueue* thief) {
+    unsigned long long range = atomic_load(&victim->range);
+
+    while (RANGE_BEGIN(range) < RANGE_END(range)) {
+        int begin = RANGE_BEGIN(range);
+        int end = RANGE_END(range);
+        int middle = begin + (end - begin) / 2;
+
+        if (atomic_compare_exchange_weak(&victim->range, &range, RANGE(begin, middle))) {
+            atomic_store(&thief->range, RANGE(middle, end));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//runs programs from the worker's own queue, then steals from the others until every queue is empty.
+//work is never added after the start, so one full pass of failed steals means the batch is done.
+void* batchWorker(void* arg) {
+    BatchWorker* worker = arg;
+    Batch* batch = worker->batch;
+    WorkQueue* own = &batch->queues[worker->id];
+    int index;
+
+    while (1) {
+        index = takeWork(own);
+        if (index != -1) {
+            batch->results[index] = assembler_interpreter(batch->programs[index]);
+            continue;
+        }
+
+        int stolen = 0;
+        for (int i = 1; i < batch->numWorkers && !stolen; i++) {
+            stolen = stealWork(&batch->queues[(worker->id + i) % batch->numWorkers], own);
+        }
+        if (!stolen) return NULL;
+    }
+}
+
+//starts numThreads workers that share quantum sized turns between every job submitted.
+Scheduler* openScheduler(int numThreads, long long quantum) {
+    Scheduler* sched = calloc(1, sizeof(Scheduler));
+
+    if (sched == NULL) return NULL;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->ready, NULL);
+    pthread_cond_init(&sched->finished, NULL);
+    sched->quantum = quantum > 0 ? quantum : SCHEDULER_QUANTUM;
+    sched->threads = calloc(numThreads > 0 ? numThreads : 1, sizeof(pthread_t));
+
+    for (int i = 0; i < numThreads; i++) {
+        if (pthread_create(&sched->threads[sched->numThreads], NULL, schedulerWorker, sched) == 0) sched->numThreads++;
+    }
+    if (sched->numThreads == 0) {
+        closeScheduler(sched);
+        return NULL;
+    }
+    return sched;
+}
+
+//lets the workers finish every job still queued, then stops them. every job has to be waited for first.
+void closeScheduler(Scheduler* sched) {
+    pthread_mutex_lock(&sched->lock);
+    sched->stopping = 1;
+    pthread_cond_broadcast(&sched->ready);
+    pthread_mutex_unlock(&sched->lock);
+
+    for (int i = 0; i < sched->numThreads; i++) pthread_join(sched->threads[i], NULL);
+    pthread_cond_destroy(&sched->finished);
+    pthread_cond_destroy(&sched->ready);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched->threads);
+    free(sched->queue);
+    free(sched);
+}
+
+//queues a run of pgm, which has to stay alive until the job is waited for. fuel caps the instructions the whole
+//run may take, 0 or less meaning no cap, and a job that runs out of it fails.
+Job* submitJob(Scheduler* sched, const Program* pgm, long long fuel) {
+    Job* job = calloc(1, sizeof(Job));
+
+    if (job == NULL) return NULL;
+    job->ctx = openRun(pgm);
+    job->fuel = fuel > 0 ? fuel : FUEL_UNLIMITED;
+
+    pthread_mutex_lock(&sched->lock);
+    if (job->ctx == NULL || queueJob(sched, job) == -1) {
+        if (job->ctx != NULL) closeRun(job->ctx);
+        job->result = (char*) -1;
+        job->finished = 1;
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return job;
+}
+
+//blocks until the job has finished, frees it and returns its result.
+char* waitJob(Scheduler* sched, Job* job) {
+    char* result;
+
+    pthread_mutex_lock(&sched->lock);
+    while (!job->finished) pthread_cond_wait(&sched->finished, &sched->lock);
+    pthread_mutex_unlock(&sched->lock);
+
+    result = job->result;
+    free(job);
+    return result;
+}
+
+//adds a job to the back of the run queue, a ring that doubles when it is full. called with the lock held.
+int queueJob(Scheduler* sched, Job* job) {
+    if (sched->count == sched->capacity) {
+        int capacity = sched->capacity < MIN_CAPACITY ? MIN_CAPACITY : sched->capacity * 2;
+        Job** queue = malloc(capacity * sizeof(Job*));
+
+        if (queue == NULL) return -1;
+        for (int i = 0; i < sched->count; i++) queue[i] = sched->queue[(sched->head + i) % sched->capacity];
+        free(sched->queue);
+        sched->queue = queue;
+        sched->head = 0;
+        sched->capacity = capacity;
+    }
+    sched->queue[(sched->head + sched->count) % sched->capacity] = job;
+    sched->count++;
+    pthread_cond_signal(&sched->ready);
+    return 0;
+}
+
+//takes the job at the front, gives it one quantum outside the lock and queues it again if it yielded.
+void* schedulerWorker(void* arg) {
+    Scheduler* sched = arg;
+
+    pthread_mutex_lock(&sched->lock);
+    while (1) {
+        Job* job;
+        long long slice;
+        int status;
+
+        while (sched->count == 0 && !sched->stopping) pthread_cond_wait(&sched->ready, &sched->lock);
+        if (sched->count == 0) break;
+        job = sched->queue[sched->head];
+        sched->head = (sched->head + 1) % sched->capacity;
+        sched->count--;
+        pthread_mutex_unlock(&sched->lock);
+
+        slice = job->fuel < sched->quantum ? job->fuel : sched->quantum;
+        status = resumeRun(job->ctx, slice);
+        if (job->fuel != FUEL_UNLIMITED) job->fuel -= slice - job->ctx->fuel;
+        if (status != RUN_YIELDED || job->fuel <= 0) job->result = closeRun(job->ctx);
+
+        pthread_mutex_lock(&sched->lock);
+        if (status == RUN_YIELDED && job->fuel > 0 && queueJob(sched, job) == 0) continue;
+        if (status == RUN_YIELDED && job->fuel > 0) job->result = closeRun(job->ctx);
+        job->finished = 1;
+        pthread_cond_broadcast(&sched->finished);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+InterpreterPool* openPool(void) {
+    InterpreterPool* pool = calloc(1, sizeof(InterpreterPool));
+
+    if (pool != NULL) pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+//frees the pool and every interpreter released to it.
+void closePool(InterpreterPool* pool) {
+    while (pool->idle != NULL) {
+        Interpreter* interp = pool->idle;
+
+        pool->idle = interp->next;
+        arenaFree(&interp->scratch);
+        arenaFree(&interp->storage);
+        free(interp->output.data);
+        free(interp->returnStack);
+        free(interp);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+//an idle interpreter of the pool, or a new one when none is idle. NULL when out of memory.
+Interpreter* acquireInterpreter(InterpreterPool* pool) {
+    Interpreter* interp;
+
+    pthread_mutex_lock(&pool->lock);
+    interp = pool->idle;
+    if (interp != NULL) pool->idle = interp->next;
+    pthread_mutex_unlock(&pool->lock);
+    if (interp != NULL) return interp;
+
+    interp = calloc(1, sizeof(Interpreter));
+    if (interp == NULL) return NULL;
+    interp->output.data = calloc(MIN_OUTPUT, sizeof(char));
+    interp->output.capacity = MIN_OUTPUT;
+    if (interp->output.data == NULL) {
+        free(interp);
+        return NULL;
+    }
+    return interp;
+}
+
+void releaseInterpreter(InterpreterPool* pool, Interpreter* interp) {
+    pthread_mutex_lock(&pool->lock);
+    interp->next = pool->idle;
+    pool->idle = interp;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//assembler_interpreter on a pooled interpreter. the result belongs to interp and stays valid until its next run,
+//(char*) -1 when the program fails. only the parts of the interpreter the last run used get reset: the arenas
+//are rewound, the output and return stack emptied, and the context is a fresh one on the C stack.
+const char* interpret(Interpreter* interp, const char* source) {
+    Program* pgm = compileInto(source, POOL_OPTIONS, NULL, &interp->scratch, &interp->storage);
+    Context ctx;
+
+    arenaReset(&interp->scratch);
+    if (pgm == NULL) {
+        arenaReset(&interp->storage);
+        return (char*) -1;
+    }
+
+    memset(&ctx, 0, sizeof(Context));
+    ctx.validEnd = 1;
+    ctx.program = pgm;
+    ctx.maxDepth = pgm->maxDepth;
+    ctx.fuel = FUEL_UNLIMITED;
+    ctx.output = interp->output;
+    ctx.output.length = 0;
+    ctx.output.data[0] = '\0';
+    ctx.returnStack = interp->returnStack;
+    ctx.stackCapacity = interp->stackCapacity;
+    runProgram(&ctx);
+
+    interp->output = ctx.output;
+    interp->returnStack = ctx.returnStack;
+    interp->stackCapacity = ctx.stackCapacity;
+    interp->storage = pgm->arena;
+    arenaReset(&interp->storage);
+    return ctx.validEnd == -1 ? (char*) -1 : interp->output.data;
+}
+
+
+void printRegisters(Context* ctx) {
+    for (int i = 0; i < 26; i++) {
+        printf("%d, ", ctx->registers[i]);
+    }
+}
+
+//scanners for the end of a word (ENDS_WORD) and the end of a line, both stop at the terminating '\0'.
+#if LEXER_VECTOR
+unsigned wordMask(const char* block) {
+    VECTOR bytes = VECTOR_LOAD(block);
+    VECTOR ends = VECTOR_OR(VECTOR_OR(VECTOR_HAS(bytes, ' '), VECTOR_HAS(bytes, '\t')),
+                            VECTOR_OR(VECTOR_HAS(bytes, ','), VECTOR_HAS(bytes, ';')));
+
+    return VECTOR_MASK(VECTOR_OR(ends, VECTOR_OR(VECTOR_HAS(bytes, '\n'), VECTOR_HAS(bytes, '\0'))));
+}
+
+unsigned lineMask(const char* block) {
+    VECTOR bytes = VECTOR_LOAD(block);
+
+    return VECTOR_MASK(VECTOR_OR(VECTOR_HAS(bytes, '\n'), VECTOR_HAS(bytes, '\0')));
+}
+
+const char* scanWord(const char* program) {
+    unsigned offset = (uintptr_t)program & (LEXER_VECTOR - 1);
+    const char* block = program - offset;
+    unsigned mask = wordMask(block) >> offset;
+
+    if (mask != 0) return program + __builtin_ctz(mask);
+    do {
+        block += LEXER_VECTOR;
+        mask = wordMask(block);
+    } while (mask == 0);
+    return block + __builtin_ctz(mask);
+}
+
+const char* scanLine(const char* program) {
+    unsigned offset = (uintptr_t)program & (LEXER_VECTOR - 1);
+    const char* block = program - offset;
+    unsigned mask = lineMask(block) >> offset;
+
+    if (mask != 0) return program + __builtin_ctz(mask);
+    do {
+        block += LEXER_VECTOR;
+        mask = lineMask(block);
+    } while (mask == 0);
+    return block + __builtin_ctz(mask);
+}
+#else
+const char* scanWord(const char* program) {
+    while (!ENDS_WORD(*program)) program++;
+    return program;
+}
+
+const char* scanLine(const char* program) {
+    while (*program != '\0' && *program != '\n') program++;
+    return program;
+}
+#endif
+
+//copies the word at the cursor into string, cut to fit, and moves the cursor past all of it.
+void copyWord(const char** program, char* string, int size) {
+    const char* end = scanWord(*program);
+    int length = end - *program < size - 1 ? (int)(end - *program) : size - 1;
+
+    memcpy(string, *program, length);
+    string[length] = '\0';
+    *program = end;
+}
+
+//admin functions to clean blank spaces and unused characters. neither one ever moves past the end of the line.
+void removeComment(const char** program) {
+    *program = scanLine(*program);
+}
+
+void trimLine(const char** program) {
+    while (IS_BLANK(**program) || **program == ',') (*program)++;
+}
+
+//print the tokens produced by lexer to verify correct lexical analysis.
+void printTokens(Instruction* token, int numTokens) {
+    for (int i = 0; i < numTokens; i++, token++) {
+        printf("Opcode: %d\n"
+               "Opcode: %s\n"
+               "Value: %d\n"
+               "ToRegister: %c\n"
+               "FromRegister: %c\n"
+               "Label: %s\n"
+               "Msg: %.*s\n"
+               "//////////////////\n",
+               token->opcode,
+               token->opcodeString,
+               token->value,
+               token->toRegister,
+               token->fromRegister,
+               token->lbl,
+               token->messageLength,
+               token->message != NULL ? token->message : "");
+    }
+}
+
+//print functions created by lexer to verify correct lexical analysis.
+void printFunctions(Compiler* comp) {
+    Function* func = comp->functions;
+  
+    for (int i = 0; i < comp->numFunctions; func++, i++) {
+        printf("\nFunction Label: %s\n"
+               "Number of tokens: %d\n"
+               "Printing tokens:\n\n",
+               func->lbl, func->numRoutines);
+        printTokens(func->subroutine, func->numRoutines);
+    }
+}
+
+void printToken(Instruction* token) {
+    printf("Opcode: %d\n"
+               "Opcode: %s\n"
+               "Value: %d\n"
+               "ToRegister: %c\n"
+               "FromRegister: %c\n"
+               "Label: %s\n"
+               "Msg: %.*s\n"
+               "//////////////////\n",
+               token->opcode,
+               token->opcodeString,
+               token->value,
+               token->toRegister,
+               token->fromRegister,
+               token->lbl,
+               token->messageLength,
+               token->message != NULL ? token->message : "");
+}
+
+//parses the opcode of the instruction and fills in the instruction data structure.
+void parseOpcode(char* string, Instruction* instr) {
+    size_t length = strlen(string);
+    int opcode;
+
+    if (length == 0) return;
+    opcode = opcodeTable[OPCODE_HASH(string, length)];
+    if (opcode != -1 && strcmp(string, operations[opcode]) == 0) {
+        instr->opcode = opcode;
+        strncpy(instr->opcodeString, operations[opcode], (size_t)MAX_LBL);
+    }
+}
+
+//next parsing functions are called by the lexer once it verifies the opcode based on the rules.
+void parseMov(const char** program, Instruction* instr) {
+    char temp[MAX_LBL] = {0};
+    int currentValue = 0;
+    int negative = 1;
+    
+    if (ENDS_WORD(**program)) return;
+    instr->toRegister = **program;
+    (*program)++;
+    trimLine(program);
+  
+    if (**program == '-') {
+      negative = -1;
+      (*program)++;
+    }
+  
+    for (int i = 0; i < MAX_LBL - 1 && !ENDS_WORD(**program); i++, (*program)++) {
+        temp[i] = **program;
         temp[i + 1] = '\0';
     }
   
@@ -252,12 +1940,9 @@ void parseMath(const char** program, Instruction* instr) {
     }
     
     if (**program >= 'a' && **program <= 'z') instr->toRegister = **program;
-    (*program)++;
-    if (instr->opcode == INC || instr->opcode == DEC) {
-        (*program)++;
-        return;
-    }
-    while (INVALID_CHAR_DP || **program == ',') (*program)++;
+    if (**program != '\0') (*program)++;
+    if (instr->opcode == INC || instr->opcode == DEC) return;
+    trimLine(program);
   
     if (**program == '-') {
       negative = -1;
@@ -278,78 +1963,52 @@ void parseMath(const char** program, Instruction* instr) {
 }
 
 void parseJmp(const char** program, Instruction* instr) {
-    char label[MAX_LBL] = {0};
+    char label[MAX_LBL];
 
-    for (int i = 0; !INVALID_CHAR_DP && i < MAX_LBL; i++, (*program)++) {
-        label[i] = **program;
-    }
-    (*program)++;
+    copyWord(program, label, MAX_LBL);
     strncpy(instr->opcodeString, operations[instr->opcode], 4 * sizeof(char));
     strncpy(instr->lbl, label, (size_t)MAX_LBL);
 }
 
+//the text of a msg stays in the source until the encoder lays it out, so it has no length limit.
 void parseMsg(const char** program, Instruction* instr) {
-    char tempMessage[MAX_MSG] = {0};
-    
-    for (int i = 0; i < MAX_MSG && **program != '\n' && **program != '\0'; i++, (*program)++) {
-        if (**program == ';') {
-            removeComment(program);
-            tempMessage[i] = '\n';
-            tempMessage[i + 1] = '\0';
-            break;
-        }
-        tempMessage[i] = **program;
-        tempMessage[i + 1] = '\0';
-    }
-    strncpy(instr->message, tempMessage, (size_t)MAX_MSG);
+    const char* start = *program;
+
+    while (**program != '\n' && **program != '\0' && **program != ';') (*program)++;
+    instr->message = start;
+    instr->messageLength = *program - start;
+    if (**program == ';') removeComment(program);
 }
 
-void parseLbl(const char** program, char* string, Function* functions) {    
-    char instructions[MAX_CODE_LEN] = {0};
+//a label opens a subroutine when the line after it is indented. the subroutine owns the tokens of the
+//indented lines that follow, the lexer closes it at the first line that is empty or starts in the first column.
+int parseLbl(const char** program, char* string, Compiler* comp, int* current) {
+    Function* func;
+
     string[strlen(string) - 1] = '\0';
-    
-    int i = 0;
-    
-    Function* func = calloc(1, sizeof(Function));
-    
-    for (; i < MAX_CODE_LEN;) {
-      
-        if (**program == '\n' || **program == '\0') break;
-        
-        while(**program != '\n' && **program != '\0') {
-          
-            if (**program == ';') {
-                removeComment(program);
-                break;
-            }
-            instructions[i++] = **program;
-            (*program)++;
-        }
-        instructions[i++] = **program;
-        if (**program == '\0') break;
-      
-        if ( (*(*program + 1) != ' ' && *(*program + 2) != ' ' && *(*program + 3) != ' ' && *(*program + 4) != ' ') && *(*program + 1) != '\t') break;
-        (*program)++;
-    }
-    instructions[i] = '\0';
-    
+    removeComment(program);
+    if (**program != '\n' || !IS_BLANK(*(*program + 1))) return 0;
+
+    closeFunction(comp, current);
+    comp->functions = growArray(&comp->arena, comp->functions, &comp->maxFunctions, comp->numFunctions, sizeof(Function));
+    if (comp->functions == NULL) return -1;
+    func = &comp->functions[comp->numFunctions];
     strncpy(func->lbl, string, (size_t)MAX_LBL);
-    if (strlen(instructions) > 1) {
-      lexer(instructions, func->subroutine, &func->numRoutines, functions);  
-      memcpy(&functions[numFunctions], func, sizeof(Function));
-      numFunctions++;
-    }
-    
+    func->start = comp->numTokens;
+    *current = comp->numFunctions++;
+    return 0;
+}
+
+//ends the open subroutine, if any. a label with no instructions under it does not become a subroutine.
+void closeFunction(Compiler* comp, int* current) {
+    if (*current != -1 && comp->functions[*current].numRoutines == 0) comp->numFunctions--;
+    *current = -1;
 }
 
 void parseCall(const char** program, Instruction* instr) {
-    char label[MAX_LBL] = {0};
+    char label[MAX_LBL];
     
-    for (int i = 0; i < MAX_LBL && !INVALID_CHAR_DP; i++, (*program)++) {
-        label[i] = **program;
-        label[i + 1] = '\0';
-    }
-   
+    copyWord(program, label, MAX_LBL);
     strncpy(instr->lbl, label, (size_t)MAX_LBL);
 }
 
@@ -359,7 +2018,6 @@ void parseCmp(const char** program, Instruction* instr) {
     int tempY = 0;
   
     if (**program >= 'a' && **program <= 'z') {
-        tempX = registers[**program - 'a'];
         instr->toRegister = **program;
         (*program)++;
     } else {
@@ -367,7 +2025,7 @@ void parseCmp(const char** program, Instruction* instr) {
             negative = -1;
             (*program)++;
         }
-        while (**program != ',') {
+        while (!ENDS_WORD(**program)) {
             tempX *= 10;
             tempX += **program - '0';
             (*program)++;
@@ -375,10 +2033,9 @@ void parseCmp(const char** program, Instruction* instr) {
         instr->compareX = tempX * negative;
     }
   
-    while (INVALID_CHAR_DP || **program == ',') (*program)++;
+    trimLine(program);
     negative = 1;
     if (**program >= 'a' && **program <= 'z') {
-        tempY = registers[**program - 'a'];
         instr->fromRegister = **program;
         (*program)++;
       
@@ -389,7 +2046,7 @@ void parseCmp(const char** program, Instruction* instr) {
             (*program)++;
         }
       
-        while (!INVALID_CHAR_DP) {
+        while (!ENDS_WORD(**program)) {
             tempY *= 10;
             tempY += **program - '0';
             (*program)++;
@@ -405,32 +2062,33 @@ void parseRet(Instruction* instr) {
     strcpy(instr->opcodeString, operations[RET]);
 }
 
-//the actual lexical analyzer that creates and fills in tokens
-void lexer(const char* program, Instruction* tokenizedProgram, int* nTokens, Function* functions) {
+//the actual lexical analyzer that creates and fills in tokens. it makes one forward pass over the source and
+//never copies it: every instruction lands in comp->tokens in source order, and each subroutine is recorded as
+//the run of tokens that its indented lines produced. returns -1 when it runs out of memory.
+int lexer(const char* program, Compiler* comp) {
     int MAXLEN = MAX_LBL;
     Instruction* instr;
-    Instruction* tokenPtr = tokenizedProgram;
     char string[MAXLEN];
+    int current = -1;
     
  
     while (*program != '\0') {
-        memset(string, 0, sizeof(char) * MAXLEN);
-
-        trimLine(&program);   
-        if (*program == '\0') return;
-      
-        instr = createInstr();
-        for (int i = 0; i < MAXLEN - 1 && !INVALID_CHAR; i++) {
-            string[i] = *program;
+        if (!IS_BLANK(*program)) closeFunction(comp, &current);
+        trimLine(&program);
+        if (*program == ';') removeComment(&program);
+        if (*program == '\n') {
             program++;
+            continue;
         }
-
-        if (strcmp(string, "\0") == 0) continue;
+        if (*program == '\0') break;
+      
+        comp->tokens = growArray(&comp->arena, comp->tokens, &comp->maxTokens, comp->numTokens, sizeof(Instruction));
+        if (comp->tokens == NULL) return -1;
+        instr = &comp->tokens[comp->numTokens];
+        resetInstr(instr);
+        copyWord(&program, string, MAXLEN);
         parseOpcode(string, instr);
-        if (instr->opcode != -1) {
-            if (*program == '\0') return;
-            trimLine(&program);
-        }
+        trimLine(&program);
        
         switch(instr->opcode) {
             
@@ -479,7 +2137,6 @@ void lexer(const char* program, Instruction* tokenizedProgram, int* nTokens, Fun
             
             case RET:
               parseRet(instr);  
-              program++;
               break;
             
             case JMP:
@@ -512,242 +2169,3504 @@ void lexer(const char* program, Instruction* tokenizedProgram, int* nTokens, Fun
             
             default:
               instr->opcode = LBL;
-              if ( (*(program + 1) == ' ' && *(program + 2) == ' ' && *(program + 3) == ' ' && *(program + 4) == ' ') || *(program + 1) == '\t'){
-                trimLine(&program);
-                parseLbl(&program, string, functions);
-              }            
+              if (parseLbl(&program, string, comp, &current) == -1) return -1;
         }
       
         
         if (instr->opcode != LBL && instr->opcode != -1) {
-            (*nTokens)++; 
-            memcpy(tokenPtr, instr, sizeof(Instruction));
-            tokenPtr++;          
+            comp->numTokens++; 
+            if (current != -1) comp->functions[current].numRoutines++;
         }
+
+        //whatever is left on the line is a comment.
+        removeComment(&program);
+        if (*program == '\n') program++;
    }    
+    closeFunction(comp, &current);
 
+    for (int i = 0; i < comp->numFunctions; i++) {
+        comp->functions[i].subroutine = comp->tokens + comp->functions[i].start;
+    }
+    return 0;
 }
 
-//execute operations are called based on the type of opcode found in each instruction data structure. 
-//these functions will execute the actual instructions based on the passed instruction data structure. 
-void executeMov(Instruction* instr) {
-    if (instr->fromRegister != '\0') {
-        registers[instr->toRegister - 'a'] = registers[instr->fromRegister - 'a'];
-    } else {
-        registers[instr->toRegister - 'a'] = instr->value;
+//resolves the label of a jump or call into the index of its function, so the executor never compares label strings.
+int linkLabel(Instruction* instr, Compiler* comp) {
+    for (int i = 0; i < comp->numFunctions; i++) {
+        if (strcmp(instr->lbl, comp->functions[i].lbl) == 0) {
+            instr->target = i;
+            return 0;
+        }
     }
+    return -1;
 }
 
-void executeMathOp(Instruction* instr) {
-  
-    switch(instr->opcode) {
-        
-        case INC:
-          registers[instr->toRegister - 'a'] += 1;
+//link pass run once after the lexer. every jump and call in the main stream and in the subroutines gets a target,
+//an unknown label makes the whole program invalid.
+int linker(Compiler* comp) {
+    Instruction* instr = comp->tokens;
+
+    for (int i = 0; i < comp->numTokens; i++, instr++) {
+        if ((instr->opcode == JMP || instr->opcode == CLL || (instr->opcode >= JNE && instr->opcode <= JL)) &&
+            linkLabel(instr, comp) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//maps a register name onto its index in registers[]. '\0' means the operand is an immediate.
+int encodeRegister(char name, unsigned char* index) {
+    if (name == '\0') {
+        *index = NO_REG;
+        return 0;
+    }
+    if (name < 'a' || name > 'z') return -1;
+  
+    *index = name - 'a';
+    return 0;
+}
+
+//appends a segment to the message being encoded. text that follows text is merged into one segment, the pool
+//keeps it contiguous. returns -1 when it runs out of memory.
+int addSegment(Compiler* comp, int reg, const char* text, int length) {
+    Program* pgm = comp->program;
+
+    if (reg == NO_REG) {
+        if (length == 0) return 0;
+        while (pgm->textSize + length > comp->maxText) {
+            pgm->text = growArray(&pgm->arena, pgm->text, &comp->maxText, comp->maxText, 1);
+            if (pgm->text == NULL) return -1;
+        }
+        memcpy(pgm->text + pgm->textSize, text, length);
+        if (pgm->numSegments > pgm->messages[pgm->numMessages] && pgm->segments[pgm->numSegments - 1].reg == NO_REG) {
+            pgm->segments[pgm->numSegments - 1].length += length;
+            pgm->textSize += length;
+            return 0;
+        }
+    }
+    pgm->segments = growArray(&pgm->arena, pgm->segments, &comp->maxSegments, pgm->numSegments, sizeof(MsgSegment));
+    if (pgm->segments == NULL) return -1;
+    pgm->segments[pgm->numSegments].offset = reg == NO_REG ? pgm->textSize : 0;
+    pgm->segments[pgm->numSegments].length = reg == NO_REG ? length : 0;
+    pgm->segments[pgm->numSegments].reg = reg;
+    pgm->numSegments++;
+    if (reg == NO_REG) pgm->textSize += length;
+    return 0;
+}
+
+//lays a msg out once as quoted text and register slots, so running it never reads the text again.
+//blanks and commas separate the arguments, a quote runs to the next quote or the end of the line.
+int encodeMessage(Compiler* comp, const char* text, int length) {
+    Program* pgm = comp->program;
+    const char* end = text + length;
+
+    while (text < end) {
+        if (IS_BLANK(*text) || *text == ',' || *text == '\r') {
+            text++;
+        } else if (*text == '\'') {
+            const char* close = ++text;
+
+            while (close < end && *close != '\'') close++;
+            if (addSegment(comp, NO_REG, text, close - text) == -1) return -1;
+            text = close + 1;
+        } else if (*text >= 'a' && *text <= 'z') {
+            if (addSegment(comp, *text - 'a', NULL, 0) == -1) return -1;
+            text++;
+        } else {
+            return -1;
+        }
+    }
+    pgm->numMessages++;
+    pgm->messages[pgm->numMessages] = pgm->numSegments;
+    return pgm->numMessages - 1;
+}
+
+//encodes one linked token. the last token of a stream has to leave it, otherwise it becomes BADEND.
+int encodeInstr(Instruction* instr, Bytecode* bc, Compiler* comp, int last) {
+    Program* pgm = comp->program;
+
+    bc->opcode = instr->opcode;
+    bc->value = instr->opcode == CMP ? instr->compareX : instr->value;
+  
+    if (encodeRegister(instr->toRegister, &bc->toRegister) == -1 ||
+        encodeRegister(instr->fromRegister, &bc->fromRegister) == -1) {
+        return -1;
+    }
+    if (instr->opcode <= DIV && bc->toRegister == NO_REG) return -1;
+  
+    switch(instr->opcode) {
+      
+        case CMP:
+          bc->operand = instr->compareY;
+          break;
+        
+        case MSG:
+          bc->operand = encodeMessage(comp, instr->message, instr->messageLength);
+          if (bc->operand == -1) return -1;
+          break;
+        
+        case JMP: case JNE: case JE: case JGE: case JG: case JLE: case JL: case CLL:
+          bc->target = pgm->entries[instr->target];
+          break;
+    }
+  
+    if (last && instr->opcode != END && instr->opcode != RET && instr->opcode != JMP && instr->opcode != CLL) {
+        bc->opcode = BADEND;
+    }
+    return 0;
+}
+
+//packs the linked token stream into one code array. the main stream is every token outside a subroutine and
+//comes first, each subroutine follows at its entry, and every stream is closed by a RET.
+int encoder(Compiler* comp) {
+    Program* pgm = comp->program;
+    Function* functions = comp->functions;
+    Instruction* tokens = comp->tokens;
+    int numMain = comp->numTokens;
+    int numMsgs = 0;
+    int written = 0;
+    int pc = 0;
+  
+    for (int f = 0; f < comp->numFunctions; f++) numMain -= functions[f].numRoutines;
+    for (int i = 0; i < comp->numTokens; i++) {
+        if (tokens[i].opcode == MSG) numMsgs++;
+    }
+  
+    pgm->numCode = numMain + 1;
+    pgm->numEntries = comp->numFunctions;
+    pgm->entries = arenaAlloc(&pgm->arena, (comp->numFunctions + 1) * sizeof(int));
+    pgm->names = arenaAlloc(&pgm->arena, (comp->numFunctions + 1) * sizeof(*pgm->names));
+    if (pgm->entries == NULL || pgm->names == NULL) return -1;
+    for (int f = 0; f < comp->numFunctions; f++) {
+        memcpy(pgm->names[f], functions[f].lbl, MAX_LBL);
+        pgm->entries[f] = pgm->numCode;
+        pgm->numCode += functions[f].numRoutines + 1;
+    }
+    pgm->code = arenaAlloc(&pgm->arena, pgm->numCode * sizeof(Bytecode));
+    pgm->messages = arenaAlloc(&pgm->arena, (numMsgs + 1) * sizeof(int));
+    if (pgm->code == NULL || pgm->messages == NULL) return -1;
+    pgm->messages[0] = 0;
+  
+    //subroutines are recorded in source order, so one cursor is enough to step over them.
+    for (int i = 0, f = 0; i < comp->numTokens && written != -1; i++) {
+        if (f < comp->numFunctions && i == functions[f].start) {
+            i += functions[f].numRoutines - 1;
+            f++;
+            continue;
+        }
+        written = encodeInstr(&tokens[i], &pgm->code[pc], comp, pc == numMain - 1);
+        pc++;
+    }
+    pgm->code[numMain].opcode = RET;
+  
+    for (int f = 0; f < comp->numFunctions && written != -1; f++) {
+        Bytecode* bc = pgm->code + pgm->entries[f];
+      
+        for (int i = 0; i < functions[f].numRoutines && written != -1; i++) {
+            written = encodeInstr(&functions[f].subroutine[i], bc + i, comp, i == functions[f].numRoutines - 1);
+        }
+        bc[functions[f].numRoutines].opcode = RET;
+    }
+    return written;
+}
+
+//the number of instructions a call to the subroutine in [entry, end) inlines to, or -1 when it can not be inlined.
+//only leaves that run straight through to a single ret qualify, so the copy never has to leave the caller.
+int inlineBody(const Program* pgm, int entry, int end) {
+    int last = end - 2;
+    int op = pgm->code[last].opcode;
+
+    if (last < entry || (op != RET && op != END) || last - entry > INLINE_BUDGET) return -1;
+    for (int i = entry; i < last; i++) {
+        op = pgm->code[i].opcode;
+        if (op > DIV && op != CMP && op != MSG) return -1;
+    }
+    return last - entry;
+}
+
+//inlines small leaf subroutines at their call sites, then turns a call that is followed by ret or end into a jmp,
+//since the callee's own ret then leaves the caller's frame just the same. subroutines that are no longer called
+//are left for the data-flow pass to prune. out of memory, the program is left as it was.
+void inlineProgram(Program* pgm) {
+    Arena scratch = {0};
+    int* bodySize = arenaAlloc(&scratch, (pgm->numCode + 1) * sizeof(int));
+    int* newIndex = arenaAlloc(&scratch, (pgm->numCode + 1) * sizeof(int));
+    Bytecode* code;
+    int numCode = 0;
+
+    if (bodySize == NULL || newIndex == NULL) {
+        arenaFree(&scratch);
+        return;
+    }
+    for (int i = 0; i < pgm->numCode; i++) bodySize[i] = -1;
+    for (int f = 0; f < pgm->numEntries; f++) {
+        int end = f + 1 < pgm->numEntries ? pgm->entries[f + 1] : pgm->numCode;
+
+        bodySize[pgm->entries[f]] = inlineBody(pgm, pgm->entries[f], end);
+    }
+
+    for (int i = 0; i < pgm->numCode; i++) {
+        const Bytecode* bc = &pgm->code[i];
+
+        newIndex[i] = numCode;
+        numCode += bc->opcode == CLL && bodySize[bc->target] != -1 ? bodySize[bc->target] : 1;
+    }
+    code = arenaAlloc(&pgm->arena, numCode * sizeof(Bytecode));
+    if (code == NULL) {
+        arenaFree(&scratch);
+        return;
+    }
+
+    for (int i = 0; i < pgm->numCode; i++) {
+        const Bytecode* bc = &pgm->code[i];
+        Bytecode* copy = &code[newIndex[i]];
+
+        if (bc->opcode == CLL && bodySize[bc->target] != -1) {
+            memcpy(copy, &pgm->code[bc->target], bodySize[bc->target] * sizeof(Bytecode));
+            continue;
+        }
+        *copy = *bc;
+        if (bc->opcode == JMP || bc->opcode == CLL || IS_CONDITIONAL(bc->opcode)) copy->target = newIndex[bc->target];
+    }
+    for (int i = 0; i + 1 < numCode; i++) {
+        if (code[i].opcode == CLL && (code[i + 1].opcode == RET || code[i + 1].opcode == END)) code[i].opcode = JMP;
+    }
+
+    for (int f = 0; f < pgm->numEntries; f++) pgm->entries[f] = newIndex[pgm->entries[f]];
+    pgm->code = code;
+    pgm->numCode = numCode;
+    arenaFree(&scratch);
+}
+
+//computes left op right the way the executors do, wrapping on overflow. returns -1 for the divisions that trap,
+//those are left for run time.
+int foldMath(int opcode, int left, int right, int* result) {
+    switch(opcode) {
+        case INC: *result = (int)((unsigned)left + 1u); return 0;
+        case DEC: *result = (int)((unsigned)left - 1u); return 0;
+        case ADD: *result = (int)((unsigned)left + (unsigned)right); return 0;
+        case SUB: *result = (int)((unsigned)left - (unsigned)right); return 0;
+        case MUL: *result = (int)((unsigned)left * (unsigned)right); return 0;
+        case DIV:
+          if (right == 0 || (right == -1 && left == -2147483647 - 1)) return -1;
+          *result = left / right;
+          return 0;
+    }
+    return -1;
+}
+
+//the registers a msg prints.
+unsigned messageUses(const Program* pgm, int message) {
+    unsigned uses = 0;
+
+    for (int i = pgm->messages[message]; i < pgm->messages[message + 1]; i++) {
+        if (pgm->segments[i].reg != NO_REG) uses |= 1u << pgm->segments[i].reg;
+    }
+    return uses;
+}
+
+//forward pass over one stream: substitutes known registers into operands, turns arithmetic on constants into
+//a mov, and settles compares of constants, a branch that is always taken becomes a jmp and one that never is goes.
+//main is entered once with every register and the comparison zeroed unless the program is seeded, a subroutine
+//can be entered in any state.
+void propagateStream(Program* pgm, FlowGraph* graph, int stream) {
+    FlowState state;
+    int result;
+
+    memset(&state, 0, sizeof(FlowState));
+    if (stream == 0 && !graph->seeded) state.known = FLOW_ALL;
+
+    for (int i = graph->start[stream]; i < graph->end[stream] - 1; i++) {
+        Bytecode* bc = &pgm->code[i];
+        unsigned to = FLOW_REG(bc->toRegister);
+        int leaves = 0;
+
+        if (graph->dead[i]) continue;
+        if (bc->fromRegister != NO_REG && (state.known & FLOW_REG(bc->fromRegister)) && bc->opcode <= CMP &&
+            bc->opcode != INC && bc->opcode != DEC) {
+            if (bc->opcode == CMP) {
+                bc->operand = state.values[bc->fromRegister];
+            } else {
+                bc->value = state.values[bc->fromRegister];
+            }
+            bc->fromRegister = NO_REG;
+        }
+
+        switch(bc->opcode) {
+
+            case MOV:
+              if (bc->fromRegister == NO_REG) {
+                  state.known |= to;
+                  state.values[bc->toRegister] = bc->value;
+              } else {
+                  state.known &= ~to;
+              }
+              break;
+
+            case INC: case DEC: case ADD: case SUB: case MUL: case DIV:
+              if ((state.known & to) && bc->fromRegister == NO_REG &&
+                  foldMath(bc->opcode, state.values[bc->toRegister], bc->value, &result) == 0) {
+                  bc->opcode = MOV;
+                  bc->value = result;
+                  state.values[bc->toRegister] = result;
+              } else {
+                  state.known &= ~to;
+              }
+              break;
+
+            case CMP:
+              if (bc->toRegister != NO_REG && (state.known & to)) {
+                  bc->value = state.values[bc->toRegister];
+                  bc->toRegister = NO_REG;
+              }
+              state.known &= ~FLOW_CMP;
+              if (bc->toRegister == NO_REG && bc->fromRegister == NO_REG) {
+                  state.known |= FLOW_CMP;
+                  state.cmpX = bc->value;
+                  state.cmpY = bc->operand;
+              }
+              break;
+
+            case JNE: case JE: case JGE: case JG: case JLE: case JL:
+              if (state.known & FLOW_CMP) {
+                  Context settled;
+
+                  settled.cmpX = state.cmpX;
+                  settled.cmpY = state.cmpY;
+                  if (branchTaken(&settled, bc->opcode)) {
+                      bc->opcode = JMP;
+                      leaves = 1;
+                  } else {
+                      graph->dead[i] = 1;
+                  }
+              }
+              break;
+
+            case CLL:
+              state.known = 0;
+              break;
+
+            case JMP: case RET: case END: case BADEND:
+              leaves = 1;
+              break;
+        }
+
+        //nothing jumps into the middle of a stream, so whatever follows an exit can never run.
+        if (leaves) {
+            for (int j = i + 1; j < graph->end[stream] - 1; j++) graph->dead[j] = 1;
+            return;
+        }
+    }
+}
+
+//backward pass over one stream, returns the set that is live at its entry. an exit from main ends the program
+//so nothing is live there, while a subroutine's caller may read anything. with apply set, the stores nobody
+//reads are marked dead. a div is never dropped since it can trap.
+unsigned streamLiveness(const Program* pgm, FlowGraph* graph, int stream, int apply) {
+    unsigned live = 0;
+
+    for (int i = graph->end[stream] - 1; i >= graph->start[stream]; i--) {
+        const Bytecode* bc = &pgm->code[i];
+        unsigned to = FLOW_REG(bc->toRegister);
+        unsigned from = FLOW_REG(bc->fromRegister);
+
+        if (graph->dead[i]) continue;
+        switch(bc->opcode) {
+
+            case RET: case END:
+              live = stream == 0 ? 0 : FLOW_ALL;
+              break;
+
+            case BADEND:
+              live = 0;
+              break;
+
+            case JMP:
+              live = graph->liveIn[graph->streamOf[bc->target]];
+              break;
+
+            case JNE: case JE: case JGE: case JG: case JLE: case JL:
+              live |= graph->liveIn[graph->streamOf[bc->target]] | FLOW_CMP;
+              break;
+
+            case CLL:
+              live = FLOW_ALL;
+              break;
+
+            case MSG:
+              live |= messageUses(pgm, bc->operand);
+              break;
+
+            case DIV:
+              live |= to | from;
+              break;
+
+            case CMP:
+              if (!(live & FLOW_CMP)) {
+                  if (apply) graph->dead[i] = 1;
+                  break;
+              }
+              live = (live & ~FLOW_CMP) | to | from;
+              break;
+
+            case MOV: case INC: case DEC: case ADD: case SUB: case MUL:
+              if (!(live & to)) {
+                  if (apply) graph->dead[i] = 1;
+                  break;
+              }
+              live = bc->opcode == MOV ? (live & ~to) | from : live | to | from;
+              break;
+        }
+    }
+    return live;
+}
+
+//data-flow optimizer: constant propagation and branch folding per stream, then pruning of the subroutines nothing
+//reaches any more, then dead store elimination on liveness solved over the whole graph. the surviving slots are
+//packed down and every target and entry remapped. what msg prints, and whether the program ends, never changes.
+void optimizeProgram(Program* pgm, int options) {
+    Arena scratch = {0};
+    FlowGraph graph;
+    int* stack;
+    int* newIndex;
+    int depth = 0;
+    int changed = 1;
+    int numCode = 0;
+    int numEntries = 0;
+
+    graph.numStreams = pgm->numEntries + 1;
+    graph.seeded = (options & OPTIMIZE_SEEDED) != 0;
+    graph.start = arenaAlloc(&scratch, graph.numStreams * sizeof(int));
+    graph.end = arenaAlloc(&scratch, graph.numStreams * sizeof(int));
+    graph.streamOf = arenaAlloc(&scratch, pgm->numCode * sizeof(int));
+    graph.liveIn = arenaAlloc(&scratch, graph.numStreams * sizeof(unsigned));
+    graph.reachable = arenaAlloc(&scratch, graph.numStreams);
+    graph.dead = arenaAlloc(&scratch, pgm->numCode);
+    stack = arenaAlloc(&scratch, graph.numStreams * sizeof(int));
+    newIndex = arenaAlloc(&scratch, (pgm->numCode + 1) * sizeof(int));
+    //the pass only rewrites the program once all of this is had, without it the program is left as it was.
+    if (graph.start == NULL || graph.end == NULL || graph.streamOf == NULL || graph.liveIn == NULL ||
+        graph.reachable == NULL || graph.dead == NULL || stack == NULL || newIndex == NULL) {
+        arenaFree(&scratch);
+        return;
+    }
+
+    for (int s = 0; s < graph.numStreams; s++) {
+        graph.start[s] = s == 0 ? 0 : pgm->entries[s - 1];
+        graph.end[s] = s == pgm->numEntries ? pgm->numCode : pgm->entries[s];
+        graph.streamOf[graph.start[s]] = s;
+    }
+    for (int s = 0; s < graph.numStreams; s++) propagateStream(pgm, &graph, s);
+
+    graph.reachable[0] = 1;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int s = stack[--depth];
+
+        for (int i = graph.start[s]; i < graph.end[s]; i++) {
+            int op = pgm->code[i].opcode;
+            int target;
+
+            if (graph.dead[i] || (op != JMP && op != CLL && !IS_CONDITIONAL(op))) continue;
+            target = graph.streamOf[pgm->code[i].target];
+            if (!graph.reachable[target]) {
+                graph.reachable[target] = 1;
+                stack[depth++] = target;
+            }
+        }
+    }
+
+    while (changed) {
+        changed = 0;
+        for (int s = graph.numStreams - 1; s >= 0; s--) {
+            unsigned live = graph.reachable[s] ? streamLiveness(pgm, &graph, s, 0) : 0;
+
+            if (live != graph.liveIn[s]) {
+                graph.liveIn[s] = live;
+                changed = 1;
+            }
+        }
+    }
+    for (int s = 0; s < graph.numStreams; s++) {
+        if (graph.reachable[s]) {
+            streamLiveness(pgm, &graph, s, 1);
+        } else {
+            memset(graph.dead + graph.start[s], 1, graph.end[s] - graph.start[s]);
+        }
+    }
+
+    //a removed slot maps to the next one kept, which is in the same stream since a live stream keeps its ret.
+    for (int i = 0; i < pgm->numCode; i++) {
+        newIndex[i] = numCode;
+        if (!graph.dead[i]) numCode++;
+    }
+    for (int i = 0; i < pgm->numCode; i++) {
+        Bytecode* bc = &pgm->code[i];
+
+        if (graph.dead[i]) continue;
+        if (bc->opcode == JMP || bc->opcode == CLL || IS_CONDITIONAL(bc->opcode)) bc->target = newIndex[bc->target];
+        pgm->code[newIndex[i]] = *bc;
+    }
+    for (int s = 1; s < graph.numStreams; s++) {
+        if (!graph.reachable[s]) continue;
+        if (pgm->names != NULL) memmove(pgm->names[numEntries], pgm->names[s - 1], MAX_LBL);
+        pgm->entries[numEntries++] = newIndex[graph.start[s]];
+    }
+    pgm->numCode = numCode;
+    pgm->numEntries = numEntries;
+    arenaFree(&scratch);
+}
+
+//summarizes every stream, numbered as in the data-flow pass. the registers written on every path are solved
+//forward per stream, a read of one not among them is a read of what the stream was called with. calls and jumps
+//into other streams use the summary of that stream, and everything is repeated until no summary changes, so
+//recursion is covered. returns -1 when it runs out of memory.
+int summarizeStreams(const Program* pgm, StreamSummary* summaries) {
+    Arena scratch = {0};
+    int numStreams = pgm->numEntries + 1;
+    int* start = arenaAlloc(&scratch, (numStreams + 1) * sizeof(int));
+    int* streamAt = arenaAlloc(&scratch, pgm->numCode * sizeof(int));
+    unsigned* written = arenaAlloc(&scratch, pgm->numCode * sizeof(unsigned));
+    unsigned* added = arenaAlloc(&scratch, numStreams * sizeof(unsigned));
+    unsigned* others = arenaAlloc(&scratch, numStreams * sizeof(unsigned));
+    int changed = 1;
+
+    if (start == NULL || streamAt == NULL || written == NULL || added == NULL || others == NULL) {
+        arenaFree(&scratch);
+        return -1;
+    }
+
+    for (int s = 0; s < numStreams; s++) {
+        start[s] = s == 0 ? 0 : pgm->entries[s - 1];
+        summaries[s].reads = 0;
+        summaries[s].writes = 0;
+        summaries[s].always = FLOW_ALL;
+        summaries[s].accumulated = 0;
+        summaries[s].pure = 1;
+    }
+    start[numStreams] = pgm->numCode;
+    for (int s = 0; s < numStreams; s++) {
+        for (int i = start[s]; i < start[s + 1]; i++) streamAt[i] = s;
+    }
+
+    while (changed) {
+        changed = 0;
+        for (int s = 0; s < numStreams; s++) {
+            StreamSummary next = {0, 0, FLOW_ALL, 0, 1};
+            int moved = 1;
+
+            for (int i = start[s]; i < start[s + 1]; i++) written[i] = FLOW_ALL;
+            written[start[s]] = 0;
+            while (moved) {
+                moved = 0;
+                for (int i = start[s]; i < start[s + 1]; i++) {
+                    const Bytecode* bc = &pgm->code[i];
+                    int op = baseOpcode(bc->opcode);
+                    unsigned uses = 0;
+                    unsigned after = written[i];
+                    int follows = 1;
+                    int target = -1;
+
+                    if (op <= DIV) {
+                        uses = FLOW_REG(bc->fromRegister) | (op == MOV ? 0 : FLOW_REG(bc->toRegister));
+                        after |= FLOW_REG(bc->toRegister);
+                        if (written[i] != FLOW_ALL) next.writes |= FLOW_REG(bc->toRegister);
+                    } else if (op == CMP) {
+                        uses = FLOW_REG(bc->fromRegister) | FLOW_REG(bc->toRegister);
+                        after |= FLOW_CMP;
+                        if (written[i] != FLOW_ALL) next.writes |= FLOW_CMP;
+                    } else if (IS_CONDITIONAL(op)) {
+                        uses = FLOW_CMP;
+                        target = bc->target;
+                    } else if (op == JMP) {
+                        follows = 0;
+                        target = bc->target;
+                    } else if (op == CLL) {
+                        const StreamSummary* callee = &summaries[streamAt[bc->target]];
+
+                        next.reads |= callee->reads & ~after;
+                        next.writes |= callee->writes;
+                        next.pure &= callee->pure;
+                        after |= callee->always;
+                    } else if (op == MSG) {
+                        next.pure = 0;
+                    } else {
+                        if (op != BADEND) next.always &= after;
+                        follows = 0;
+                    }
+                    next.reads |= uses & ~written[i];
+
+                    if (target != -1 && streamAt[target] == s) {
+                        if ((written[target] & after) != written[target]) moved = 1;
+                        written[target] &= after;
+                    } else if (target != -1) {
+                        const StreamSummary* other = &summaries[streamAt[target]];
+
+                        next.reads |= other->reads & ~after;
+                        next.writes |= other->writes;
+                        next.always &= after | other->always;
+                        next.pure &= other->pure;
+                    }
+                    if (follows && i + 1 < start[s + 1]) {
+                        if ((written[i + 1] & after) != written[i + 1]) moved = 1;
+                        written[i + 1] &= after;
+                    }
+                }
+            }
+
+            if (memcmp(&next, &summaries[s], sizeof(StreamSummary)) != 0) {
+                summaries[s] = next;
+                changed = 1;
+            }
+        }
+    }
+
+    //accumulators: every use of them anywhere the stream reaches is the destination of an inc, dec, add or sub.
+    for (int i = 0; i < pgm->numCode; i++) {
+        const Bytecode* bc = &pgm->code[i];
+        int op = baseOpcode(bc->opcode);
+
+        if (op == INC || op == DEC || op == ADD || op == SUB) {
+            added[streamAt[i]] |= FLOW_REG(bc->toRegister);
+            others[streamAt[i]] |= FLOW_REG(bc->fromRegister);
+        } else if (op <= DIV || op == CMP) {
+            others[streamAt[i]] |= FLOW_REG(bc->toRegister) | FLOW_REG(bc->fromRegister);
+        }
+    }
+    changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < pgm->numCode; i++) {
+            int op = baseOpcode(pgm->code[i].opcode);
+            int from;
+            int to = streamAt[i];
+
+            if (op == CMP || op < JMP || op > CLL) continue;
+            from = streamAt[pgm->code[i].target];
+            if ((added[from] & ~added[to]) || (others[from] & ~others[to])) changed = 1;
+            added[to] |= added[from];
+            others[to] |= others[from];
+        }
+    }
+    for (int s = 0; s < numStreams; s++) summaries[s].accumulated = added[s] & ~others[s];
+    arenaFree(&scratch);
+    return 0;
+}
+
+//the plain instruction a slot started as. a superinstruction keeps every field of its first instruction and only
+//adds to ones that instruction leaves unused, so reading it as baseOpcode gives back the unfused program.
+int baseOpcode(int opcode) {
+    switch(opcode) {
+        case CMPJ: return CMP;
+        case INCJ: return INC;
+        case DECJ: return DEC;
+        case MOVOP: return MOV;
+    }
+    return opcode;
+}
+
+//peephole pass over the encoded program. the loop shapes inc/dec + cmp + jcc and cmp + jcc, and a mov straight
+//into an op with an immediate, become one superinstruction in their first slot. the slots it covers stay where they
+//are, so no code index moves, and they can never be jumped into since targets are always stream entries.
+void fuseProgram(Program* pgm) {
+    Bytecode* code = pgm->code;
+
+    for (int i = 0; i + 1 < pgm->numCode; i++) {
+        Bytecode* bc = &code[i];
+        Bytecode* next = &code[i + 1];
+
+        if ((bc->opcode == INC || bc->opcode == DEC) && i + 2 < pgm->numCode &&
+            next->opcode == CMP && next->toRegister == bc->toRegister && IS_CONDITIONAL(code[i + 2].opcode)) {
+            bc->opcode = bc->opcode == INC ? INCJ : DECJ;
+            bc->fromRegister = next->fromRegister;
+            bc->operand = next->operand;
+            bc->fused = code[i + 2].opcode;
+            bc->target = code[i + 2].target;
+            i += 2;
+        } else if (bc->opcode == CMP && IS_CONDITIONAL(next->opcode)) {
+            bc->opcode = CMPJ;
+            bc->fused = next->opcode;
+            bc->target = next->target;
+            i++;
+        } else if (bc->opcode == MOV && (next->opcode == ADD || next->opcode == SUB || next->opcode == MUL) &&
+                   next->toRegister == bc->toRegister && next->fromRegister == NO_REG) {
+            bc->opcode = MOVOP;
+            bc->fused = next->opcode;
+            bc->operand = next->value;
+            i++;
+        }
+    }
+}
+
+//releases a program from compileProgram or loadProgram. the Program itself lives in its own arena.
+void freeProgram(Program* pgm) {
+    Arena storage = pgm->arena;
+
+    if (pgm->image != NULL) munmap(pgm->image, pgm->imageSize);
+    if (pgm->native != NULL) munmap(pgm->native, pgm->nativeSize);
+    arenaFree(&storage);
+}
+
+//execute operations are called based on the type of opcode found in each instruction data structure. 
+//these functions will execute the actual instructions based on the passed instruction data structure. 
+void executeMov(Context* ctx, Bytecode* instr) {
+    if (instr->fromRegister != NO_REG) {
+        ctx->registers[instr->toRegister] = ctx->registers[instr->fromRegister];
+    } else {
+        ctx->registers[instr->toRegister] = instr->value;
+    }
+}
+
+void executeMathOp(Context* ctx, Bytecode* instr) {
+  
+    switch(instr->opcode) {
+        
+        case INC:
+          ctx->registers[instr->toRegister] += 1;
           break;
         
         case DEC:
-          registers[instr->toRegister - 'a'] -= 1;
+          ctx->registers[instr->toRegister] -= 1;
           break;
         
         case DIV:
-          if (instr->fromRegister != '\0') {
-              registers[instr->toRegister - 'a'] /= registers[instr->fromRegister  - 'a'];
+          if (instr->fromRegister != NO_REG) {
+              ctx->registers[instr->toRegister] /= ctx->registers[instr->fromRegister];
           } else {
-              registers[instr->toRegister - 'a'] /= instr->value;
+              ctx->registers[instr->toRegister] /= instr->value;
           }
           break;
         
         case MUL:
-          if (instr->fromRegister != '\0') {
-              registers[instr->toRegister - 'a'] *= registers[instr->fromRegister  - 'a'];
+          if (instr->fromRegister != NO_REG) {
+              ctx->registers[instr->toRegister] *= ctx->registers[instr->fromRegister];
           } else {
-              registers[instr->toRegister - 'a'] *= instr->value;
+              ctx->registers[instr->toRegister] *= instr->value;
           }
           break;
         
           case ADD:
-          if (instr->fromRegister != '\0') {
-              registers[instr->toRegister - 'a'] += registers[instr->fromRegister  - 'a'];
+          if (instr->fromRegister != NO_REG) {
+              ctx->registers[instr->toRegister] += ctx->registers[instr->fromRegister];
           } else {
-              registers[instr->toRegister - 'a'] += instr->value;
+              ctx->registers[instr->toRegister] += instr->value;
           }
           break;        
         
         case SUB:
-          if (instr->fromRegister != '\0') {
-              registers[instr->toRegister - 'a'] -= registers[instr->fromRegister  - 'a'];
+          if (instr->fromRegister != NO_REG) {
+              ctx->registers[instr->toRegister] -= ctx->registers[instr->fromRegister];
           } else {
-              registers[instr->toRegister - 'a'] -= instr->value;
+              ctx->registers[instr->toRegister] -= instr->value;
           }
           break;  
     }
 }
 
-void executeCall(Instruction* instr) {
-    
-    Instruction* calledPtr;
-    for (int i = 0; i < numFunctions; i++) {
-        if (strcmp(instr->lbl, functions[i].lbl) == 0) {
-            calledPtr = functions[i].subroutine;
-            executor(calledPtr, &functions[i].numRoutines);
-            return;
-        }
+//calls and returns never touch the C stack: the slot after the call goes on the context's return stack, which
+//only grows when it is full. returns -1 when the call would nest deeper than maxDepth.
+int pushReturn(Context* ctx, int pc) {
+    if (ctx->depth == ctx->stackCapacity) {
+        int capacity = ctx->stackCapacity < MIN_CAPACITY ? MIN_CAPACITY : ctx->stackCapacity * 2;
+        int* stack;
+
+        if (ctx->depth >= ctx->maxDepth) return -1;
+        if (capacity > ctx->maxDepth) capacity = ctx->maxDepth;
+        stack = realloc(ctx->returnStack, capacity * sizeof(int));
+        if (stack == NULL) return -1;
+        ctx->returnStack = stack;
+        ctx->stackCapacity = capacity;
     }
+    ctx->returnStack[ctx->depth++] = pc;
+    return 0;
+}
+
+int executeCall(Context* ctx, Bytecode** instr) {
+    const Bytecode* code = ctx->program->code;
+
+    if (pushReturn(ctx, *instr - code + 1) == -1) return -1;
+    *instr = ctx->program->code + (*instr)->target;
+    return 0;
 }
 
-void executeCmp(Instruction* instr) {
-    if (instr->toRegister != '\0') {
-        cmpX = registers[instr->toRegister - 'a'];
+void executeCmp(Context* ctx, Bytecode* instr) {
+    if (instr->toRegister != NO_REG) {
+        ctx->cmpX = ctx->registers[instr->toRegister];
     } else {
-        cmpX = instr->compareX;
+        ctx->cmpX = instr->value;
     }
   
-    if (instr->fromRegister != '\0') {
-        cmpY = registers[instr->fromRegister - 'a'];
+    if (instr->fromRegister != NO_REG) {
+        ctx->cmpY = ctx->registers[instr->fromRegister];
     } else {
-        cmpY = instr->compareY;
+        ctx->cmpY = instr->operand;
     }
 }
 
-void executeJmp(Instruction** instr, int* pgmCounter) {
+int branchTaken(const Context* ctx, int opcode) {
       
-    if ((*instr)->opcode == JNE && cmpX != cmpY)       comparator = 1;
-    else if ((*instr)->opcode == JE && cmpX == cmpY)   comparator = 1;
-    else if ((*instr)->opcode == JGE && cmpX >= cmpY)  comparator = 1;
-    else if ((*instr)->opcode == JG && cmpX > cmpY)    comparator = 1;
-    else if ((*instr)->opcode == JLE && cmpX <= cmpY)  comparator = 1;
-    else if ((*instr)->opcode == JL && cmpX < cmpY)    comparator = 1;
-    else if ((*instr)->opcode == JMP)                  comparator = 1; 
-    else                                               comparator = 0;
+    if (opcode == JNE && ctx->cmpX != ctx->cmpY)       return 1;
+    else if (opcode == JE && ctx->cmpX == ctx->cmpY)   return 1;
+    else if (opcode == JGE && ctx->cmpX >= ctx->cmpY)  return 1;
+    else if (opcode == JG && ctx->cmpX > ctx->cmpY)    return 1;
+    else if (opcode == JLE && ctx->cmpX <= ctx->cmpY)  return 1;
+    else if (opcode == JL && ctx->cmpX < ctx->cmpY)    return 1;
+    else if (opcode == JMP)                  return 1; 
+    return 0;
+}
+
+void executeJmp(Context* ctx, Bytecode** instr) {
+    ctx->comparator = branchTaken(ctx, (*instr)->opcode);
     
-    if (comparator == 1) {
-        for (int i = 0; i < numFunctions; i++) {
-            if (strcmp((*instr)->lbl, functions[i].lbl) == 0) {
-                *instr = functions[i].subroutine;
-                *pgmCounter = 0;
-                return;
-            }
-        }
+    if (ctx->comparator == 1) {
+        *instr = ctx->program->code + (*instr)->target;
+        return;
     }
     (*instr)++;   
 }
 
-void executeRet(int* returnFlag) {
-    *returnFlag = 1;
-}
+//a superinstruction does the work of every slot it covers, then continues after the last of them.
+void executeFused(Context* ctx, Bytecode** instr) {
+    Bytecode* bc = *instr;
+    int* registers = ctx->registers;
+    int source;
 
-void executeMsg(Instruction* instr) {
-    memset(formattedMsg, 0, sizeof(char) * MAX_MSG);
-    char* msgPtr = instr->message;
-    char* formMsgPtr = formattedMsg; 
-    
-    for (int i = 0; i < strlen(instr->message); i++) {
-        while (*msgPtr == ' ' || *msgPtr == ',') {
-            msgPtr++;
-            i++;
-        }
-        if (*msgPtr == '\0' || *msgPtr == '\n') return;
-      
-        if (*msgPtr == '\'') {
-            msgPtr++;
-            i++;
-            while (*msgPtr != '\'' && *msgPtr != '\0') {
-                *formMsgPtr = *msgPtr; 
-                formMsgPtr++;
-                msgPtr++;
-                i++;
-            }
-            msgPtr++;
-        } else {
-            sprintf(formMsgPtr, "%d", registers[*msgPtr - 'a']);
-            while(*formMsgPtr != '\0') formMsgPtr++;
-            msgPtr++;
-        }      
+    switch(bc->opcode) {
+
+        case CMPJ:
+          executeCmp(ctx, bc);
+          break;
+
+        case INCJ: case DECJ:
+          registers[bc->toRegister] += bc->opcode == INCJ ? 1 : -1;
+          ctx->cmpX = registers[bc->toRegister];
+          ctx->cmpY = bc->fromRegister != NO_REG ? registers[bc->fromRegister] : bc->operand;
+          break;
+
+        case MOVOP:
+          source = bc->fromRegister != NO_REG ? registers[bc->fromRegister] : bc->value;
+          if (bc->fused == ADD)      registers[bc->toRegister] = source + bc->operand;
+          else if (bc->fused == SUB) registers[bc->toRegister] = source - bc->operand;
+          else                       registers[bc->toRegister] = source * bc->operand;
+          *instr += 2;
+          return;
     }
+
+    ctx->comparator = branchTaken(ctx, bc->fused);
+    *instr = ctx->comparator == 1 ? ctx->program->code + bc->target : bc + FUSED_LENGTH(bc->opcode);
 }
 
-//the actual driver that moves through the list of tokens and calls the respective execute functions based on the instruction data structure opcode.
-void executor(Instruction* tokenizedProgram, int* numTokens) {
-    Instruction* instrPtr = tokenizedProgram;
-    int pgmCounter = 0;
-  
-    while (pgmCounter++ <= *numTokens) {
+//returns -1 once the outermost frame returns, which ends the program.
+int executeRet(Context* ctx, Bytecode** instr) {
+    if (ctx->depth == 0) return -1;
+    *instr = ctx->program->code + ctx->returnStack[--ctx->depth];
+    return 0;
+}
 
-        if (pgmCounter == *numTokens && (instrPtr->opcode != END && instrPtr->opcode != RET &&
-                                         instrPtr->opcode != JMP && instrPtr->opcode != CLL)) {
-            validEnd = -1;
-            return;     
-        }     
-      
-        switch(instrPtr->opcode) {
-            
-             case MOV:
-                executeMov(instrPtr);
-                instrPtr++;
-                break;
-             case INC:
-                executeMathOp(instrPtr);
-                instrPtr++;
-                break;
-             case DEC:
-                executeMathOp(instrPtr);
-                instrPtr++;
-                break;
+//room for size more bytes and the terminator. on failure the buffer is left as it was.
+int reserveOutput(OutputBuffer* out, int size) {
+    int capacity = out->capacity;
+    char* data;
+
+    if (out->length + size < capacity) return 0;
+    while (out->length + size >= capacity) capacity = capacity == 0 ? MIN_OUTPUT : capacity * 2;
+
+    data = realloc(out->data, capacity);
+    if (data == NULL) return -1;
+    out->data = data;
+    out->capacity = capacity;
+    return 0;
+}
+
+void appendText(OutputBuffer* out, const char* text, int length) {
+    if (reserveOutput(out, length) == -1) return;
+    memcpy(out->data + out->length, text, length);
+    out->length += length;
+    out->data[out->length] = '\0';
+}
+
+//the decimal form of value, written back to front two digits at a time.
+void appendInt(OutputBuffer* out, int value) {
+    static const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[12];
+    char* first = digits + sizeof(digits);
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+
+    while (magnitude >= 100) {
+        first -= 2;
+        memcpy(first, digitPairs + (magnitude % 100) * 2, 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        first -= 2;
+        memcpy(first, digitPairs + magnitude * 2, 2);
+    } else {
+        *--first = (char)('0' + magnitude);
+    }
+    if (value < 0) *--first = '-';
+    appendText(out, first, digits + sizeof(digits) - first);
+}
+
+//hands data to the sink's writer in one piece. short writes to a file descriptor are retried, after a
+//failure the sink drops everything.
+void sinkWrite(OutputSink* sink, const char* data, int length) {
+    if (sink->failed) return;
+    if (sink->write != NULL) {
+        if (sink->write(sink->user, data, length) != length) sink->failed = 1;
+        return;
+    }
+    while (length > 0) {
+        ssize_t written = write(sink->fd, data, length);
+
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) {
+            sink->failed = 1;
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+//copies data into the block, flushing it whenever it fills. data at least a block long goes out directly.
+void sinkAppend(OutputSink* sink, const char* data, int length) {
+    if (sink->length + length > sink->capacity) flushSink(sink);
+    if (length >= sink->capacity) {
+        sinkWrite(sink, data, length);
+        return;
+    }
+    memcpy(sink->block + sink->length, data, length);
+    sink->length += length;
+}
+
+//replaces the output with one message, appending its segments as the encoder laid them out.
+void executeMsg(Context* ctx, int message) {
+    const Program* pgm = ctx->program;
+    const MsgSegment* segment = pgm->segments + pgm->messages[message];
+    const MsgSegment* last = pgm->segments + pgm->messages[message + 1];
+
+    ctx->output.length = 0;
+    if (ctx->output.data != NULL) ctx->output.data[0] = '\0';
+    for (; segment < last; segment++) {
+        if (segment->reg != NO_REG) {
+            appendInt(&ctx->output, ctx->registers[segment->reg]);
+        } else {
+            appendText(&ctx->output, pgm->text + segment->offset, segment->length);
+        }
+    }
+    if (ctx->sink != NULL) {
+        sinkAppend(ctx->sink, ctx->output.data, ctx->output.length);
+        sinkAppend(ctx->sink, "\n", 1);
+    }
+}
+
+//the actual driver that moves through the encoded program from entry and calls the respective execute functions based on the opcode.
+//every stream ends in end, ret, jmp or call followed by a closing ret, so there is no end-of-program test per instruction.
+//BILL charges the straight run from start up to current, CHARGE does so once the instruction at current has moved
+//instrPtr on and yields when the fuel is gone. the instructions that end a run only BILL.
+#define BILL() ctx->fuel -= current - start + 1
+#define CHARGE() \
+    BILL(); \
+    start = instrPtr; \
+    if (ctx->fuel <= 0) { \
+        ctx->pc = instrPtr - ctx->program->code; \
+        ctx->status = RUN_YIELDED; \
+        return; \
+    }
+
+void executor(Context* ctx, Bytecode* entry) {
+    Bytecode* instrPtr = entry;
+    Bytecode* start = entry;
+    Bytecode* current;
+  
+    while (1) {
+        PROFILE_STEP(ctx, instrPtr);
+        current = instrPtr;
+      
+        switch(instrPtr->opcode) {
+            
+             case MOV:
+                executeMov(ctx, instrPtr);
+                instrPtr++;
+                break;
+             case INC:
+                executeMathOp(ctx, instrPtr);
+                instrPtr++;
+                break;
+             case DEC:
+                executeMathOp(ctx, instrPtr);
+                instrPtr++;
+                break;
              case ADD:
-                executeMathOp(instrPtr);
+                executeMathOp(ctx, instrPtr);
                 instrPtr++;
                 break;
              case SUB:
-                executeMathOp(instrPtr);
+                executeMathOp(ctx, instrPtr);
                 instrPtr++;
                 break;
              case MUL:
-                executeMathOp(instrPtr);
+                executeMathOp(ctx, instrPtr);
                 instrPtr++;
                 break;
              case DIV:
-                executeMathOp(instrPtr);
+                executeMathOp(ctx, instrPtr);
                 instrPtr++;
                 break;
              case JMP:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;
              case JNE:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;            
              case JE:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;              
              case JGE:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;            
              case JG:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;            
              case JLE:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;            
              case JL:
-                executeJmp(&instrPtr, &pgmCounter);
+                executeJmp(ctx, &instrPtr);
+                CHARGE();
                 break;
              case CLL:
-                executeCall(instrPtr);
-                instrPtr++;
+                if (MEMO_RECALL(ctx, instrPtr)) {
+                    instrPtr++;
+                    CHARGE();
+                    break;
+                }
+                if (executeCall(ctx, &instrPtr) == -1) {
+                    ctx->validEnd = -1;
+                    return;
+                }
+                PROFILE_CALL(ctx, instrPtr);
+                CHARGE();
                 break;            
              case MSG:
-                executeMsg(instrPtr);
+                executeMsg(ctx, instrPtr->operand);
                 instrPtr++;
                 break;            
              case RET:
-                return;           
+                PROFILE_RET(ctx);
+                if (executeRet(ctx, &instrPtr) == -1) {
+                    BILL();
+                    return;
+                }
+                MEMO_RET(ctx);
+                CHARGE();
+                break;
              case CMP:
-                executeCmp(instrPtr);
+                executeCmp(ctx, instrPtr);
                 instrPtr++;
                 break;            
              case END:
-                validEnd *= 1;
+                ctx->validEnd *= 1;
+                PROFILE_RET(ctx);
+                if (executeRet(ctx, &instrPtr) == -1) {
+                    BILL();
+                    return;
+                }
+                MEMO_RET(ctx);
+                CHARGE();
+                break;
+             case BADEND:
+                ctx->validEnd = -1;
+                BILL();
                 return;
+             case CMPJ: case INCJ: case DECJ: case MOVOP:
+                executeFused(ctx, &instrPtr);
+                CHARGE();
+                break;
         }                                  
     }
-} 
\ No newline at end of file
+} 
+#undef CHARGE
+#undef BILL
+
+//second engine: direct threaded code. loadEngine pre-decodes every slot into the address of its handler, picking the
+//register or immediate form of each operation up front, and each handler jumps straight to the next one.
+//called with entry -1 it only fills pgm->handlers, since the handler addresses are local to this function.
+NO_TAIL_MERGE void threadedExecutor(Context* ctx, const Program* pgm, int entry) {
+#if HAVE_THREADED
+    static const void* labels[] = {
+        [MOV] = &&movImm, [INC] = &&inc, [DEC] = &&dec, [ADD] = &&addImm, [SUB] = &&subImm, [MUL] = &&mulImm,
+        [DIV] = &&divImm, [JMP] = &&jmp, [CMP] = &&cmp, [JNE] = &&jne, [JE] = &&je, [JGE] = &&jge, [JG] = &&jg,
+        [JLE] = &&jle, [JL] = &&jl, [CLL] = &&call, [RET] = &&ret, [MSG] = &&msg, [END] = &&ret, [BADEND] = &&badEnd
+    };
+    static const void* registerForms[] = {
+        [MOV] = &&movReg, [ADD] = &&addReg, [SUB] = &&subReg, [MUL] = &&mulReg, [DIV] = &&divReg
+    };
+    static const void* cmpjForms[] = {
+        [JNE] = &&cmpjne, [JE] = &&cmpje, [JGE] = &&cmpjge, [JG] = &&cmpjg, [JLE] = &&cmpjle, [JL] = &&cmpjl
+    };
+    static const void* incjForms[] = {
+        [JNE] = &&incjne, [JE] = &&incje, [JGE] = &&incjge, [JG] = &&incjg, [JLE] = &&incjle, [JL] = &&incjl
+    };
+    static const void* decjForms[] = {
+        [JNE] = &&decjne, [JE] = &&decje, [JGE] = &&decjge, [JG] = &&decjg, [JLE] = &&decjle, [JL] = &&decjl
+    };
+    static const void* movopForms[] = {
+        [ADD] = &&movAdd, [SUB] = &&movSub, [MUL] = &&movMul
+    };
+    Bytecode* code = pgm->code;
+    const void** handlers = pgm->handlers;
+    int* registers;
+    Bytecode* instr;
+    int pc = entry;
+    int start = entry;
+    long long fuel;
+
+    if (entry == -1) {
+        for (int i = 0; i < pgm->numCode; i++) {
+            short op = code[i].opcode;
+
+            if (op == CMPJ) {
+                handlers[i] = cmpjForms[code[i].fused];
+            } else if (op == INCJ || op == DECJ) {
+                handlers[i] = op == INCJ ? incjForms[code[i].fused] : decjForms[code[i].fused];
+            } else if (op == MOVOP) {
+                handlers[i] = movopForms[code[i].fused];
+            } else {
+                handlers[i] = (op <= DIV && op != INC && op != DEC && code[i].fromRegister != NO_REG) ? registerForms[op] : labels[op];
+            }
+        }
+        return;
+    }
+    registers = ctx->registers;
+    fuel = ctx->fuel;
+
+//a change of course bills the straight run that led to it and is where a run out of fuel yields, the end of a
+//run only bills it.
+#define DISPATCH() instr = &code[pc]; goto *handlers[pc]
+#define NEXT() pc++; DISPATCH()
+#define BILL() fuel -= pc - start + 1
+#define TRANSFER(to) BILL(); pc = (to); start = pc; if (fuel <= 0) goto yield; DISPATCH()
+#define JUMP() TRANSFER(instr->target)
+
+    DISPATCH();
+
+    movImm: registers[instr->toRegister] = instr->value; NEXT();
+    movReg: registers[instr->toRegister] = registers[instr->fromRegister]; NEXT();
+    inc:    registers[instr->toRegister] += 1; NEXT();
+    dec:    registers[instr->toRegister] -= 1; NEXT();
+    addImm: registers[instr->toRegister] += instr->value; NEXT();
+    addReg: registers[instr->toRegister] += registers[instr->fromRegister]; NEXT();
+    subImm: registers[instr->toRegister] -= instr->value; NEXT();
+    subReg: registers[instr->toRegister] -= registers[instr->fromRegister]; NEXT();
+    mulImm: registers[instr->toRegister] *= instr->value; NEXT();
+    mulReg: registers[instr->toRegister] *= registers[instr->fromRegister]; NEXT();
+    divImm: registers[instr->toRegister] /= instr->value; NEXT();
+    divReg: registers[instr->toRegister] /= registers[instr->fromRegister]; NEXT();
+
+    cmp:
+      executeCmp(ctx, instr);
+      NEXT();
+
+    jmp: JUMP();
+    jne: if (ctx->cmpX != ctx->cmpY) { JUMP(); } NEXT();
+    je:  if (ctx->cmpX == ctx->cmpY) { JUMP(); } NEXT();
+    jge: if (ctx->cmpX >= ctx->cmpY) { JUMP(); } NEXT();
+    jg:  if (ctx->cmpX > ctx->cmpY)  { JUMP(); } NEXT();
+    jle: if (ctx->cmpX <= ctx->cmpY) { JUMP(); } NEXT();
+    jl:  if (ctx->cmpX < ctx->cmpY)  { JUMP(); } NEXT();
+
+#define SOURCE() (instr->fromRegister != NO_REG ? registers[instr->fromRegister] : instr->value)
+#define SKIP(n) pc += (n); DISPATCH()
+
+    cmpjne: executeCmp(ctx, instr); if (ctx->cmpX != ctx->cmpY) { JUMP(); } SKIP(2);
+    cmpje:  executeCmp(ctx, instr); if (ctx->cmpX == ctx->cmpY) { JUMP(); } SKIP(2);
+    cmpjge: executeCmp(ctx, instr); if (ctx->cmpX >= ctx->cmpY) { JUMP(); } SKIP(2);
+    cmpjg:  executeCmp(ctx, instr); if (ctx->cmpX > ctx->cmpY)  { JUMP(); } SKIP(2);
+    cmpjle: executeCmp(ctx, instr); if (ctx->cmpX <= ctx->cmpY) { JUMP(); } SKIP(2);
+    cmpjl:  executeCmp(ctx, instr); if (ctx->cmpX < ctx->cmpY)  { JUMP(); } SKIP(2);
+
+#define COUNT(step, cond) \
+    registers[instr->toRegister] step 1; \
+    ctx->cmpX = registers[instr->toRegister]; \
+    ctx->cmpY = instr->fromRegister != NO_REG ? registers[instr->fromRegister] : instr->operand; \
+    if (ctx->cmpX cond ctx->cmpY) { JUMP(); } \
+    SKIP(3)
+
+    incjne: COUNT(+=, !=);
+    incje:  COUNT(+=, ==);
+    incjge: COUNT(+=, >=);
+    incjg:  COUNT(+=, >);
+    incjle: COUNT(+=, <=);
+    incjl:  COUNT(+=, <);
+    decjne: COUNT(-=, !=);
+    decje:  COUNT(-=, ==);
+    decjge: COUNT(-=, >=);
+    decjg:  COUNT(-=, >);
+    decjle: COUNT(-=, <=);
+    decjl:  COUNT(-=, <);
+#undef COUNT
+
+    movAdd: registers[instr->toRegister] = SOURCE() + instr->operand; SKIP(2);
+    movSub: registers[instr->toRegister] = SOURCE() - instr->operand; SKIP(2);
+    movMul: registers[instr->toRegister] = SOURCE() * instr->operand; SKIP(2);
+
+#undef SKIP
+#undef SOURCE
+
+    call:
+      if (pushReturn(ctx, pc + 1) == -1) {
+          ctx->validEnd = -1;
+          goto leave;
+      }
+      JUMP();
+
+    msg:
+      executeMsg(ctx, instr->operand);
+      NEXT();
+
+    ret:
+      if (ctx->depth == 0) {
+          BILL();
+          goto leave;
+      }
+      TRANSFER(ctx->returnStack[--ctx->depth]);
+
+    badEnd:
+      ctx->validEnd = -1;
+      BILL();
+      goto leave;
+
+    yield:
+      ctx->pc = pc;
+      ctx->status = RUN_YIELDED;
+
+    leave:
+      ctx->fuel = fuel;
+      return;
+
+#undef JUMP
+#undef TRANSFER
+#undef BILL
+#undef NEXT
+#undef DISPATCH
+#else
+    executor(ctx, pgm->code + entry);
+#endif
+}
+
+//third engine: a template JIT for x86-64. every slot of the code array becomes a fixed sequence of machine code,
+//working on the registers in place in the Context, which r14 points at. cmpX and cmpY live sign extended in
+//r12d and r13d, call and ret are the native instructions, and msg calls back into executeMsg. the code runs on a
+//stack of its own that runProgram sizes for maxDepth, ebx counts the depth. BADEND and a call too deep throw
+//away every frame by restoring the stack pointer the entry stub saved in r15.
+#define JIT_REG(r) ((int)(offsetof(Context, registers) + (r) * sizeof(int)))
+#define JIT_MAXDEPTH ((int)offsetof(Context, maxDepth))
+#define JIT_CMPX ((int)offsetof(Context, cmpX))
+#define JIT_CMPY ((int)offsetof(Context, cmpY))
+#define JIT_VALIDEND ((int)offsetof(Context, validEnd))
+
+//once anything fails to grow nothing more is written, jitCompile then gives the program up.
+void emitBytes(Jit* jit, const char* bytes, int size) {
+    while (!jit->failed && jit->size + size > jit->capacity) {
+        jit->code = growArray(&jit->arena, jit->code, &jit->capacity, jit->capacity, 1);
+        jit->failed = jit->code == NULL;
+    }
+    if (jit->failed) return;
+    memcpy(jit->code + jit->size, bytes, size);
+    jit->size += size;
+}
+
+void emitInt(Jit* jit, int value) {
+    emitBytes(jit, (const char*)&value, sizeof(int));
+}
+
+//a rel32 to a code index, patched once every slot has an address.
+void emitTarget(Jit* jit, int target) {
+    jit->fixups = growArray(&jit->arena, jit->fixups, &jit->maxFixups, jit->numFixups, sizeof(int));
+    jit->failed |= jit->fixups == NULL;
+    if (jit->failed) return;
+    jit->fixups[jit->numFixups++] = jit->size;
+    emitInt(jit, target);
+}
+
+//translates the whole program, returns -1 and leaves it to the interpreters if anything is not supported.
+int jitCompile(Program* pgm) {
+    Jit jit = {0};
+    int* offsets = arenaAlloc(&jit.arena, (pgm->numCode + 1) * sizeof(int));
+    long pageSize = sysconf(_SC_PAGESIZE);
+    void* native;
+    size_t size;
+    int exitStub;
+    int failStub;
+    int status = 0;
+
+    if (offsets == NULL) return -1;
+
+    //entry stub: save the callee-saved registers, load the context, switch to the private stack passed in rsi
+    //and call the main stream.
+    emitBytes(&jit, "\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57", 10);
+    emitBytes(&jit, "\x49\x89\xFE", 3);
+    emitBytes(&jit, "\x45\x0F\xBF\xA6", 4);
+    emitInt(&jit, JIT_CMPX);
+    emitBytes(&jit, "\x45\x0F\xBF\xAE", 4);
+    emitInt(&jit, JIT_CMPY);
+    emitBytes(&jit, "\x31\xDB\x49\x89\xE7\x48\x89\xF4", 8);
+    emitBytes(&jit, "\xE8", 1);
+    emitTarget(&jit, 0);
+
+    //exit stub: back on the caller's stack, store the comparison back and return.
+    exitStub = jit.size;
+    emitBytes(&jit, "\x4C\x89\xFC", 3);
+    emitBytes(&jit, "\x66\x45\x89\xA6", 4);
+    emitInt(&jit, JIT_CMPX);
+    emitBytes(&jit, "\x66\x45\x89\xAE", 4);
+    emitInt(&jit, JIT_CMPY);
+    emitBytes(&jit, "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5D\x5B\xC3", 11);
+
+    //fail stub, where BADEND and a call past maxDepth land: mark the run invalid and leave.
+    failStub = jit.size;
+    emitBytes(&jit, "\x66\x41\xC7\x86", 4);
+    emitInt(&jit, JIT_VALIDEND);
+    emitBytes(&jit, "\xFF\xFF\xE9", 3);
+    emitInt(&jit, exitStub - (jit.size + 4));
+
+    for (int i = 0; i < pgm->numCode && status == 0; i++) {
+        const Bytecode* bc = &pgm->code[i];
+        int reg = bc->fromRegister != NO_REG;
+        int op = baseOpcode(bc->opcode);
+
+        //native code gains nothing from superinstructions, their first slot is translated as what it was.
+        offsets[i] = jit.size;
+        switch(op) {
+
+            case MOV:
+              if (reg) {
+                  emitBytes(&jit, "\x41\x8B\x86", 3);
+                  emitInt(&jit, JIT_REG(bc->fromRegister));
+                  emitBytes(&jit, "\x41\x89\x86", 3);
+              } else {
+                  emitBytes(&jit, "\x41\xC7\x86", 3);
+              }
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              if (!reg) emitInt(&jit, bc->value);
+              break;
+
+            case INC: case DEC:
+              emitBytes(&jit, op == INC ? "\x41\x83\x86" : "\x41\x83\xAE", 3);
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              emitBytes(&jit, "\x01", 1);
+              break;
+
+            case ADD: case SUB:
+              if (reg) {
+                  emitBytes(&jit, "\x41\x8B\x86", 3);
+                  emitInt(&jit, JIT_REG(bc->fromRegister));
+                  emitBytes(&jit, op == ADD ? "\x41\x01\x86" : "\x41\x29\x86", 3);
+                  emitInt(&jit, JIT_REG(bc->toRegister));
+              } else {
+                  emitBytes(&jit, op == ADD ? "\x41\x81\x86" : "\x41\x81\xAE", 3);
+                  emitInt(&jit, JIT_REG(bc->toRegister));
+                  emitInt(&jit, bc->value);
+              }
+              break;
+
+            case MUL:
+              emitBytes(&jit, "\x41\x8B\x86", 3);
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              if (reg) {
+                  emitBytes(&jit, "\x41\x0F\xAF\x86", 4);
+                  emitInt(&jit, JIT_REG(bc->fromRegister));
+              } else {
+                  emitBytes(&jit, "\x69\xC0", 2);
+                  emitInt(&jit, bc->value);
+              }
+              emitBytes(&jit, "\x41\x89\x86", 3);
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              break;
+
+            case DIV:
+              emitBytes(&jit, "\x41\x8B\x86", 3);
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              if (reg) {
+                  emitBytes(&jit, "\x41\x8B\x8E", 3);
+                  emitInt(&jit, JIT_REG(bc->fromRegister));
+              } else {
+                  emitBytes(&jit, "\xB9", 1);
+                  emitInt(&jit, bc->value);
+              }
+              emitBytes(&jit, "\x99\xF7\xF9\x41\x89\x86", 6);
+              emitInt(&jit, JIT_REG(bc->toRegister));
+              break;
+
+            case CMP:
+              if (bc->toRegister != NO_REG) {
+                  emitBytes(&jit, "\x41\x8B\x86", 3);
+                  emitInt(&jit, JIT_REG(bc->toRegister));
+                  emitBytes(&jit, "\x44\x0F\xBF\xE0", 4);
+              } else {
+                  emitBytes(&jit, "\x41\xBC", 2);
+                  emitInt(&jit, (short)bc->value);
+              }
+              if (bc->fromRegister != NO_REG) {
+                  emitBytes(&jit, "\x41\x8B\x86", 3);
+                  emitInt(&jit, JIT_REG(bc->fromRegister));
+                  emitBytes(&jit, "\x44\x0F\xBF\xE8", 4);
+              } else {
+                  emitBytes(&jit, "\x41\xBD", 2);
+                  emitInt(&jit, (short)bc->operand);
+              }
+              break;
+
+            case JMP:
+              emitBytes(&jit, "\xE9", 1);
+              emitTarget(&jit, bc->target);
+              break;
+
+            case JNE: case JE: case JGE: case JG: case JLE: case JL:
+              emitBytes(&jit, "\x45\x39\xEC\x0F", 4);
+              emitBytes(&jit, op == JNE ? "\x85" : op == JE ? "\x84" : op == JGE ? "\x8D" :
+                              op == JG ? "\x8F" : op == JLE ? "\x8E" : "\x8C", 1);
+              emitTarget(&jit, bc->target);
+              break;
+
+            case CLL:
+              emitBytes(&jit, "\xFF\xC3\x41\x3B\x9E", 5);
+              emitInt(&jit, JIT_MAXDEPTH);
+              emitBytes(&jit, "\x0F\x8F", 2);
+              emitInt(&jit, failStub - (jit.size + 4));
+              emitBytes(&jit, "\xE8", 1);
+              emitTarget(&jit, bc->target);
+              emitBytes(&jit, "\xFF\xCB", 2);
+              break;
+
+            case MSG:
+              //rbp keeps the unaligned stack pointer across the call into C.
+              emitBytes(&jit, "\x4C\x89\xF7\xBE", 4);
+              emitInt(&jit, bc->operand);
+              emitBytes(&jit, "\x48\x89\xE5\x48\x83\xE4\xF0\x48\xB8", 9);
+              {
+                  void (*helper)(Context*, int) = executeMsg;
+                  emitBytes(&jit, (const char*)&helper, sizeof(helper));
+              }
+              emitBytes(&jit, "\xFF\xD0\x48\x89\xEC", 5);
+              break;
+
+            case RET: case END:
+              emitBytes(&jit, "\xC3", 1);
+              break;
+
+            case BADEND:
+              emitBytes(&jit, "\xE9", 1);
+              emitInt(&jit, failStub - (jit.size + 4));
+              break;
+
+            default:
+              status = -1;
+        }
+    }
+
+    if (jit.failed) status = -1;
+    for (int i = 0; i < jit.numFixups && status == 0; i++) {
+        int target;
+
+        memcpy(&target, jit.code + jit.fixups[i], sizeof(int));
+        target = offsets[target] - (jit.fixups[i] + 4);
+        memcpy(jit.code + jit.fixups[i], &target, sizeof(int));
+    }
+
+    //written while writable, then flipped to executable so the pages are never both.
+    size = ((size_t)jit.size + pageSize - 1) / pageSize * pageSize;
+    native = status == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+    if (native != MAP_FAILED) {
+        memcpy(native, jit.code, jit.size);
+        if (mprotect(native, size, PROT_READ | PROT_EXEC) == -1) {
+            munmap(native, size);
+            native = MAP_FAILED;
+        }
+    }
+    arenaFree(&jit.arena);
+    if (native == MAP_FAILED) return -1;
+
+    pgm->native = native;
+    pgm->nativeSize = size;
+    return 0;
+}
+
+//switches a program to another engine, -1 when this build or this program can not run on it. a program that
+//was not compiled with OPTIMIZE_JIT is compiled to native code here.
+int setEngine(Program* pgm, int engine) {
+    if (engine == ENGINE_JIT && pgm->native == NULL && (!HAVE_JIT || jitCompile(pgm) == -1)) return -1;
+    if (engine == ENGINE_THREADED) {
+        if (!HAVE_THREADED) return -1;
+        if (pgm->handlers == NULL) {
+            pgm->handlers = arenaAlloc(&pgm->arena, pgm->numCode * sizeof(void*));
+            if (pgm->handlers == NULL) return -1;
+            threadedExecutor(NULL, pgm, -1);
+        }
+    }
+    pgm->engine = engine;
+    return 0;
+}
+
+//chooses the engine for a freshly encoded program and does the engine's own decoding. the threaded handlers are
+//built even when the JIT takes the program, runs that have to yield need them.
+void loadEngine(Program* pgm, int native) {
+    pgm->engine = ENGINE_SWITCH;
+    pgm->maxDepth = MAX_CALL_DEPTH;
+    if (HAVE_THREADED) pgm->handlers = arenaAlloc(&pgm->arena, pgm->numCode * sizeof(void*));
+    if (pgm->handlers != NULL) {
+        pgm->engine = ENGINE_THREADED;
+        threadedExecutor(NULL, pgm, -1);
+    }
+    if (HAVE_JIT && native && jitCompile(pgm) == 0) pgm->engine = ENGINE_JIT;
+}
+
+void freeNativeStack(void* stack) {
+    munmap(((NativeStack*)stack)->memory, ((NativeStack*)stack)->size);
+    free(stack);
+}
+
+void createNativeStackKey(void) {
+    pthread_key_create(&nativeStackKey, freeNativeStack);
+}
+
+//the top of a stack of at least size bytes for native code. every thread keeps the largest one it needed, so
+//a run does not have to map one of its own, and unmaps it when it exits. NULL when out of memory. one more page
+//is mapped below the stack and made inaccessible, so C called from native code that overruns the slack faults
+//there instead of writing into whatever is mapped underneath.
+char* nativeStack(size_t size) {
+    NativeStack* stack;
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    pthread_once(&nativeStackOnce, createNativeStackKey);
+    stack = pthread_getspecific(nativeStackKey);
+    if (stack != NULL && stack->size >= size + pageSize) return stack->memory + stack->size;
+
+    if (stack == NULL) {
+        stack = calloc(1, sizeof(NativeStack));
+        if (stack == NULL || pthread_setspecific(nativeStackKey, stack) != 0) {
+            free(stack);
+            return NULL;
+        }
+    } else {
+        munmap(stack->memory, stack->size);
+        stack->size = 0;
+    }
+    size = (size + pageSize - 1) / pageSize * pageSize + pageSize;
+    stack->memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack->memory == MAP_FAILED) return NULL;
+    if (mprotect(stack->memory, pageSize, PROT_NONE) == -1) {
+        munmap(stack->memory, size);
+        return NULL;
+    }
+    stack->size = size;
+    return stack->memory + size;
+}
+
+void runProgram(Context* ctx) {
+#ifdef ASM_PROFILE
+    if (ctx->profile != NULL) {
+        executor(ctx, ctx->program->code + ctx->pc);
+        return;
+    }
+#endif
+#ifdef ASM_MEMO
+    if (ctx->memo != NULL) {
+        executor(ctx, ctx->program->code + ctx->pc);
+        return;
+    }
+#endif
+    //native code can not stop part way, a run with a budget or one that is resuming takes the threaded engine.
+    if (ctx->program->engine == ENGINE_JIT && ctx->fuel == FUEL_UNLIMITED && ctx->pc == 0 && ctx->depth == 0) {
+        char* stack = nativeStack((size_t)ctx->maxDepth * sizeof(void*) + JIT_STACK_SLACK);
+
+        if (stack == NULL) {
+            ctx->validEnd = -1;
+            return;
+        }
+        ((void (*)(Context*, void*))ctx->program->native)(ctx, stack);
+    } else if (ctx->program->engine != ENGINE_SWITCH && ctx->program->handlers != NULL) {
+        threadedExecutor(ctx, ctx->program, ctx->pc);
+    } else {
+        executor(ctx, ctx->program->code + ctx->pc);
+    }
+}
+
+#ifdef ASM_PROFILE
+//counters for profiling runs of pgm. they add up over every executeProfiled given the same profile.
+//NULL when out of memory.
+Profile* openProfile(const Program* pgm) {
+    Arena storage = {0};
+    Profile* profile = arenaAlloc(&storage, sizeof(Profile));
+
+    if (profile == NULL) return NULL;
+    profile->arena = storage;
+    profile->program = pgm;
+    profile->numStreams = pgm->numEntries + 1;
+    profile->counts = arenaAlloc(&profile->arena, pgm->numCode * sizeof(long long));
+    profile->taken = arenaAlloc(&profile->arena, pgm->numCode * sizeof(long long));
+    profile->notTaken = arenaAlloc(&profile->arena, pgm->numCode * sizeof(long long));
+    profile->streamCalls = arenaAlloc(&profile->arena, profile->numStreams * sizeof(long long));
+    profile->inclusiveTime = arenaAlloc(&profile->arena, profile->numStreams * sizeof(long long));
+    profile->active = arenaAlloc(&profile->arena, profile->numStreams * sizeof(int));
+
+    profile->nodes = growArray(&profile->arena, NULL, &profile->maxNodes, 0, sizeof(ProfileNode));
+    if (profile->counts == NULL || profile->taken == NULL || profile->notTaken == NULL || profile->streamCalls == NULL ||
+        profile->inclusiveTime == NULL || profile->active == NULL || profile->nodes == NULL) {
+        storage = profile->arena;
+        arenaFree(&storage);
+        return NULL;
+    }
+    profile->nodes[0].parent = -1;
+    profile->nodes[0].firstChild = -1;
+    profile->nodes[0].nextSibling = -1;
+    profile->numNodes = 1;
+    return profile;
+}
+
+void closeProfile(Profile* profile) {
+    Arena storage = profile->arena;
+
+    arenaFree(&storage);
+}
+
+//runs a program on the switch engine whatever engine it was loaded for, counting into profile as it goes.
+//the result follows the assembler_interpreter contract.
+char* executeProfiled(const Program* pgm, Profile* profile) {
+    Context ctx;
+    char* result;
+
+    memset(&ctx, 0, sizeof(Context));
+    ctx.validEnd = 1;
+    ctx.program = pgm;
+    ctx.maxDepth = pgm->maxDepth;
+    ctx.profile = profile;
+
+    profile->last = NULL;
+    profile->numFrames = 0;
+    profile->failed = 0;
+    profile->streamCalls[0]++;
+    profile->nodes[0].calls++;
+    profileCall(profile, NULL);
+
+    result = runContext(&ctx);
+    profile->failed = 0;
+    while (profile->numFrames > 0) profileRet(profile);
+    return result;
+}
+
+//the stream a code index belongs to.
+int streamOf(const Program* pgm, int pc) {
+    int low = 0;
+    int high = pgm->numEntries;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (pgm->entries[middle] <= pc) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+const char* streamName(const Program* pgm, int stream, char* buffer) {
+    if (stream == 0) return "main";
+    if (pgm->names != NULL) return pgm->names[stream - 1];
+    sprintf(buffer, "sub%d", stream - 1);
+    return buffer;
+}
+
+const char* opcodeName(int opcode) {
+    switch(opcode) {
+        case CMPJ: return "cmp+jcc";
+        case INCJ: return "inc+cmp+jcc";
+        case DECJ: return "dec+cmp+jcc";
+        case MOVOP: return "mov+op";
+        case BADEND: return "(no end)";
+    }
+    return operations[opcode];
+}
+
+//counts instr and settles the jump before it, whose outcome comparator still holds.
+void profileStep(Profile* profile, const Context* ctx, const Bytecode* instr) {
+    const Bytecode* last = profile->last;
+    const Bytecode* code = profile->program->code;
+
+    if (profile->failed) return;
+    if (last != NULL && (last->opcode == JMP || IS_CONDITIONAL(last->opcode) ||
+        last->opcode == CMPJ || last->opcode == INCJ || last->opcode == DECJ)) {
+        if (ctx->comparator == 1) profile->taken[last - code]++;
+        else profile->notTaken[last - code]++;
+    }
+    profile->counts[instr - code]++;
+    profile->last = instr;
+}
+
+//opens a frame for the subroutine a call just entered, or for main when instr is NULL. when the tree or the
+//frames can not grow, profiling stops for the rest of the run and what was counted so far is kept.
+void profileCall(Profile* profile, const Bytecode* instr) {
+    int stream = instr != NULL ? streamOf(profile->program, instr - profile->program->code) : 0;
+    int node = 0;
+    ProfileFrame* frame;
+    void* grown;
+
+    if (profile->failed) return;
+    if (instr != NULL) {
+        int parent = profile->frames[profile->numFrames - 1].node;
+
+        node = parent;
+        while (node != -1 && profile->nodes[node].stream != stream) node = profile->nodes[node].parent;
+        if (node == -1) {
+            node = profile->nodes[parent].firstChild;
+            while (node != -1 && profile->nodes[node].stream != stream) node = profile->nodes[node].nextSibling;
+        }
+        if (node == -1) {
+            ProfileNode* child;
+
+            grown = growArray(&profile->arena, profile->nodes, &profile->maxNodes, profile->numNodes, sizeof(ProfileNode));
+            if (grown == NULL) {
+                profile->failed = 1;
+                return;
+            }
+            profile->nodes = grown;
+            node = profile->numNodes++;
+            child = &profile->nodes[node];
+            child->stream = stream;
+            child->parent = parent;
+            child->firstChild = -1;
+            child->nextSibling = profile->nodes[parent].firstChild;
+            profile->nodes[parent].firstChild = node;
+        }
+        profile->nodes[node].calls++;
+        profile->streamCalls[stream]++;
+    }
+
+    grown = growArray(&profile->arena, profile->frames, &profile->maxFrames, profile->numFrames, sizeof(ProfileFrame));
+    if (grown == NULL) {
+        profile->failed = 1;
+        return;
+    }
+    profile->frames = grown;
+    frame = &profile->frames[profile->numFrames++];
+    frame->node = node;
+    frame->start = monotonicNow();
+    frame->childTime = 0;
+    profile->active[stream]++;
+}
+
+//closes the innermost frame. time spent in a subroutine that is still active further out is counted there.
+void profileRet(Profile* profile) {
+    ProfileFrame* frame;
+    int stream;
+    long long elapsed;
+
+    if (profile->failed) return;
+    frame = &profile->frames[--profile->numFrames];
+    stream = profile->nodes[frame->node].stream;
+    elapsed = monotonicNow() - frame->start;
+
+    profile->nodes[frame->node].selfTime += elapsed - frame->childTime;
+    if (profile->numFrames > 0) profile->frames[profile->numFrames - 1].childTime += elapsed;
+    if (--profile->active[stream] == 0) profile->inclusiveTime[stream] += elapsed;
+}
+
+//one line per subroutine, then one per instruction that ran, with the jump outcomes of the jumps.
+void printProfile(const Profile* profile, FILE* out) {
+    const Program* pgm = profile->program;
+    char buffer[32];
+
+    fprintf(out, "%-20s %12s %14s %14s %14s\n", "subroutine", "calls", "instructions", "inclusive ms", "self ms");
+    for (int stream = 0; stream < profile->numStreams; stream++) {
+        int start = stream == 0 ? 0 : pgm->entries[stream - 1];
+        int end = stream < pgm->numEntries ? pgm->entries[stream] : pgm->numCode;
+        long long instructions = 0;
+        long long selfTime = 0;
+
+        for (int i = start; i < end; i++) instructions += profile->counts[i];
+        for (int i = 0; i < profile->numNodes; i++) {
+            if (profile->nodes[i].stream == stream) selfTime += profile->nodes[i].selfTime;
+        }
+        fprintf(out, "%-20s %12lld %14lld %14.3f %14.3f\n", streamName(pgm, stream, buffer),
+                profile->streamCalls[stream], instructions, profile->inclusiveTime[stream] / 1e6, selfTime / 1e6);
+    }
+
+    fprintf(out, "\n%-8s %-26s %-12s %14s %14s %14s\n", "slot", "location", "opcode", "count", "taken", "not taken");
+    for (int i = 0; i < pgm->numCode; i++) {
+        int stream = streamOf(pgm, i);
+        int start = stream == 0 ? 0 : pgm->entries[stream - 1];
+        char location[64];
+
+        if (profile->counts[i] == 0) continue;
+        snprintf(location, sizeof(location), "%s+%d", streamName(pgm, stream, buffer), i - start);
+        fprintf(out, "%-8d %-26s %-12s %14lld", i, location, opcodeName(pgm->code[i].opcode), profile->counts[i]);
+        if (profile->taken[i] != 0 || profile->notTaken[i] != 0) {
+            fprintf(out, " %14lld %14lld", profile->taken[i], profile->notTaken[i]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void printStack(const Profile* profile, int node, FILE* out) {
+    char buffer[32];
+
+    if (profile->nodes[node].parent != -1) {
+        printStack(profile, profile->nodes[node].parent, out);
+        fprintf(out, ";");
+    }
+    fprintf(out, "%s", streamName(profile->program, profile->nodes[node].stream, buffer));
+}
+
+//the self time of every calling context in microseconds, one "main;outer;inner 1234" line each, which is
+//the collapsed stack format flame graph tools read.
+void printCollapsedStacks(const Profile* profile, FILE* out) {
+    for (int i = 0; i < profile->numNodes; i++) {
+        if (profile->nodes[i].calls == 0) continue;
+        printStack(profile, i, out);
+        fprintf(out, " %lld\n", profile->nodes[i].selfTime / 1000);
+    }
+}
+#endif
+
+Lanes laneOperand(LaneGroup* group, int reg, int value) {
+    return reg != NO_REG ? LANES_LOAD(group->registers[reg]) : LANES_SET(value);
+}
+
+void failLane(LaneGroup* group, int lane) {
+    group->lanes[lane].validEnd = -1;
+    group->running &= ~(1u << lane);
+}
+
+//the lane executor. it picks the deepest lanes, and of those the ones furthest back in the code, so lanes that
+//split at a branch or a return meet again as early as possible. every lane at that pc then steps as one under
+//its mask until a branch splits them or they return. fused slots run as the plain instructions they cover.
+//only division, calls, returns and msg go lane by lane.
+void runLanes(LaneGroup* group, const Program* pgm) {
+    while (group->running != 0) {
+        unsigned mask = 0;
+        int depth = -1;
+        int pc = 0;
+
+        for (int l = 0; l < LANES; l++) {
+            if (!(group->running & 1u << l)) continue;
+            if (group->lanes[l].depth > depth || (group->lanes[l].depth == depth && group->pc[l] < pc)) {
+                depth = group->lanes[l].depth;
+                pc = group->pc[l];
+            }
+        }
+        for (int l = 0; l < LANES; l++) {
+            if ((group->running & 1u << l) && group->pc[l] == pc) mask |= 1u << l;
+        }
+
+        while (mask != 0) {
+            const Bytecode* bc = &pgm->code[pc];
+            int op = baseOpcode(bc->opcode);
+            Lanes active = LANES_MASK(mask);
+            Lanes result;
+            unsigned taken;
+
+            switch(op) {
+
+                case MOV: case INC: case DEC: case ADD: case SUB: case MUL:
+                  result = LANES_LOAD(group->registers[bc->toRegister]);
+                  if (op == MOV) result = laneOperand(group, bc->fromRegister, bc->value);
+                  else if (op == INC) result = LANES_ADD(result, LANES_SET(1));
+                  else if (op == DEC) result = LANES_SUB(result, LANES_SET(1));
+                  else if (op == ADD) result = LANES_ADD(result, laneOperand(group, bc->fromRegister, bc->value));
+                  else if (op == SUB) result = LANES_SUB(result, laneOperand(group, bc->fromRegister, bc->value));
+                  else result = LANES_MUL(result, laneOperand(group, bc->fromRegister, bc->value));
+                  result = LANES_SELECT(active, result, LANES_LOAD(group->registers[bc->toRegister]));
+                  LANES_STORE(group->registers[bc->toRegister], result);
+                  pc++;
+                  break;
+
+                case DIV:
+                  for (int l = 0; l < LANES; l++) {
+                      if (!(mask & 1u << l)) continue;
+                      if (bc->fromRegister != NO_REG) {
+                          group->registers[bc->toRegister][l] /= group->registers[bc->fromRegister][l];
+                      } else {
+                          group->registers[bc->toRegister][l] /= bc->value;
+                      }
+                  }
+                  pc++;
+                  break;
+
+                case CMP:
+                  result = LANES_SHORT(laneOperand(group, bc->toRegister, bc->value));
+                  LANES_STORE(group->cmpX, LANES_SELECT(active, result, LANES_LOAD(group->cmpX)));
+                  result = LANES_SHORT(laneOperand(group, bc->fromRegister, bc->operand));
+                  LANES_STORE(group->cmpY, LANES_SELECT(active, result, LANES_LOAD(group->cmpY)));
+                  pc++;
+                  break;
+
+                case JMP:
+                  pc = bc->target;
+                  break;
+
+                case JNE: case JE: case JGE: case JG: case JLE: case JL: {
+                  Lanes x = LANES_LOAD(group->cmpX);
+                  Lanes y = LANES_LOAD(group->cmpY);
+
+                  if (op == JE) result = LANES_AND(LANES_EQUAL(x, y), active);
+                  else if (op == JNE) result = LANES_AND_NOT(LANES_EQUAL(x, y), active);
+                  else if (op == JG) result = LANES_AND(LANES_GREATER(x, y), active);
+                  else if (op == JLE) result = LANES_AND_NOT(LANES_GREATER(x, y), active);
+                  else if (op == JL) result = LANES_AND(LANES_GREATER(y, x), active);
+                  else result = LANES_AND_NOT(LANES_GREATER(y, x), active);
+
+                  taken = LANES_BITS(result);
+                  if (taken == mask) {
+                      pc = bc->target;
+                  } else if (taken == 0) {
+                      pc++;
+                  } else {
+                      for (int l = 0; l < LANES; l++) {
+                          if (mask & 1u << l) group->pc[l] = taken & 1u << l ? bc->target : pc + 1;
+                      }
+                      mask = 0;
+                  }
+                  break;
+                }
+
+                case CLL:
+                  for (int l = 0; l < LANES; l++) {
+                      if ((mask & 1u << l) && pushReturn(&group->lanes[l], pc + 1) == -1) {
+                          failLane(group, l);
+                          mask &= ~(1u << l);
+                      }
+                  }
+                  pc = bc->target;
+                  break;
+
+                case MSG:
+                  for (int l = 0; l < LANES; l++) {
+                      if (!(mask & 1u << l)) continue;
+                      for (int r = 0; r < 26; r++) group->lanes[l].registers[r] = group->registers[r][l];
+                      executeMsg(&group->lanes[l], bc->operand);
+                  }
+                  pc++;
+                  break;
+
+                case RET: case END:
+                  for (int l = 0; l < LANES; l++) {
+                      Context* lane = &group->lanes[l];
+
+                      if (!(mask & 1u << l)) continue;
+                      if (lane->depth == 0) group->running &= ~(1u << l);
+                      else group->pc[l] = lane->returnStack[--lane->depth];
+                  }
+                  mask = 0;
+                  break;
+
+                case BADEND:
+                  for (int l = 0; l < LANES; l++) {
+                      if (mask & 1u << l) failLane(group, l);
+                  }
+                  mask = 0;
+                  break;
+            }
+        }
+    }
+}
+
+#ifdef ASM_MEMO
+//a memo table for pgm holding at most capacity bytes of records, 0 for MEMO_CAPACITY. NULL when out of memory.
+Memo* openMemo(const Program* pgm, size_t capacity) {
+    Arena storage = {0};
+    Memo* memo = arenaAlloc(&storage, sizeof(Memo));
+
+    if (memo == NULL) return NULL;
+    memo->arena = storage;
+    memo->program = pgm;
+    memo->capacity = capacity > 0 ? capacity : MEMO_CAPACITY;
+    memo->summaries = arenaAlloc(&memo->arena, (pgm->numEntries + 1) * sizeof(StreamSummary));
+    memo->streamAt = arenaAlloc(&memo->arena, pgm->numCode * sizeof(int));
+    if (memo->summaries == NULL || memo->streamAt == NULL || summarizeStreams(pgm, memo->summaries) == -1) {
+        storage = memo->arena;
+        arenaFree(&storage);
+        return NULL;
+    }
+    for (int i = 0; i < pgm->numCode; i++) memo->streamAt[i] = -1;
+    for (int i = 0; i < pgm->numEntries; i++) memo->streamAt[pgm->entries[i]] = i + 1;
+
+    memo->numBuckets = MEMO_BUCKETS;
+    memo->buckets = calloc(memo->numBuckets, sizeof(MemoRecord*));
+    if (memo->buckets == NULL) {
+        storage = memo->arena;
+        arenaFree(&storage);
+        return NULL;
+    }
+    memo->used = memo->numBuckets * sizeof(MemoRecord*);
+    return memo;
+}
+
+void closeMemo(Memo* memo) {
+    Arena storage = memo->arena;
+
+    arenaFree(&memo->records);
+    free(memo->buckets);
+    free(memo->frames);
+    arenaFree(&storage);
+}
+
+//runs a compiled program like executeProgram, but on the switch engine with memo remembering its calls. the
+//table is kept from one run to the next, only one run may use it at a time.
+char* executeMemoized(const Program* pgm, Memo* memo) {
+    Context ctx;
+
+    memset(&ctx, 0, sizeof(Context));
+    ctx.validEnd = 1;
+    ctx.program = pgm;
+    ctx.maxDepth = pgm->maxDepth;
+    ctx.memo = memo;
+    memo->numFrames = 0;
+    return runContext(&ctx);
+}
+
+//the registers in set in ascending order, the comparison as cmpX and cmpY. returns how many values that was.
+int gatherValues(const Context* ctx, unsigned set, int* values) {
+    int count = 0;
+
+    for (int r = 0; r < 26; r++) {
+        if (set & FLOW_REG(r)) values[count++] = ctx->registers[r];
+    }
+    if (set & FLOW_CMP) {
+        values[count++] = ctx->cmpX;
+        values[count++] = ctx->cmpY;
+    }
+    return count;
+}
+
+int scatterValues(Context* ctx, unsigned set, const int* values) {
+    int count = 0;
+
+    for (int r = 0; r < 26; r++) {
+        if (set & FLOW_REG(r)) ctx->registers[r] = values[count++];
+    }
+    if (set & FLOW_CMP) {
+        ctx->cmpX = values[count++];
+        ctx->cmpY = values[count++];
+    }
+    return count;
+}
+
+int countValues(unsigned set) {
+    int count = (set & FLOW_CMP) != 0;
+
+    for (; set != 0; set &= set - 1) count++;
+    return count;
+}
+
+unsigned memoKey(const StreamSummary* summary) {
+    return (summary->reads | (summary->writes & ~summary->always)) & ~summary->accumulated;
+}
+
+unsigned hashValues(int stream, const int* values, int count) {
+    unsigned hash = 2166136261u ^ stream;
+
+    for (int i = 0; i < count; i++) hash = (hash ^ (unsigned)values[i]) * 16777619u;
+    return hash;
+}
+
+void resetMemo(Memo* memo) {
+    arenaFree(&memo->records);
+    memset(memo->buckets, 0, memo->numBuckets * sizeof(MemoRecord*));
+    memo->numRecords = 0;
+    memo->used = memo->numBuckets * sizeof(MemoRecord*);
+    memo->resets++;
+}
+
+//stores the call frame recorded, with what ctx holds now that it has returned. the buckets double whenever there
+//are more records than buckets and the cap still allows it.
+void rememberCall(Memo* memo, const MemoFrame* frame, const Context* ctx) {
+    const StreamSummary* summary = &memo->summaries[frame->stream];
+    int numKeys = countValues(memoKey(summary));
+    int numWrites = countValues(summary->writes & ~summary->accumulated);
+    int numAccumulated = countValues(summary->accumulated);
+    size_t size = sizeof(MemoRecord) + (numKeys + numWrites + numAccumulated) * sizeof(int);
+    MemoRecord* record;
+    int* deltas;
+
+    if (memo->numRecords >= memo->numBuckets && memo->used + memo->numBuckets * sizeof(MemoRecord*) <= memo->capacity) {
+        MemoRecord** buckets = calloc(memo->numBuckets * 2, sizeof(MemoRecord*));
+
+        if (buckets != NULL) {
+            for (int b = 0; b < memo->numBuckets; b++) {
+                while (memo->buckets[b] != NULL) {
+                    MemoRecord* moved = memo->buckets[b];
+
+                    memo->buckets[b] = moved->next;
+                    moved->next = buckets[moved->hash & (memo->numBuckets * 2 - 1)];
+                    buckets[moved->hash & (memo->numBuckets * 2 - 1)] = moved;
+                }
+            }
+            free(memo->buckets);
+            memo->buckets = buckets;
+            memo->used += memo->numBuckets * sizeof(MemoRecord*);
+            memo->numBuckets *= 2;
+        }
+    }
+    if (memo->used + size > memo->capacity) resetMemo(memo);
+    if (memo->used + size > memo->capacity) return;
+
+    record = arenaAlloc(&memo->records, size);
+    if (record == NULL) return;
+    record->hash = hashValues(frame->stream, frame->values, numKeys);
+    record->stream = frame->stream;
+    record->peak = frame->peak - frame->base;
+    memcpy(record->values, frame->values, numKeys * sizeof(int));
+    gatherValues(ctx, summary->writes & ~summary->accumulated, record->values + numKeys);
+    deltas = record->values + numKeys + numWrites;
+    gatherValues(ctx, summary->accumulated, deltas);
+    for (int i = 0; i < numAccumulated; i++) {
+        deltas[i] = (int)((unsigned)deltas[i] - (unsigned)frame->values[numKeys + i]);
+    }
+    record->next = memo->buckets[record->hash & (memo->numBuckets - 1)];
+    memo->buckets[record->hash & (memo->numBuckets - 1)] = record;
+    memo->numRecords++;
+    memo->used += size;
+}
+
+//the call at instr, looked up before it is made. a hit sets what the call may write and returns 1, and it only
+//counts when the call it stands for would have fit under maxDepth. a miss of a pure stream starts recording it.
+int recallCall(Memo* memo, Context* ctx, const Bytecode* instr) {
+    int stream = memo->streamAt[instr->target];
+    MemoFrame* top = memo->numFrames > 0 ? &memo->frames[memo->numFrames - 1] : NULL;
+    const StreamSummary* summary;
+    unsigned hash;
+    int values[28];
+    int* deltas;
+    int numKeys;
+
+    if (stream == -1 || !memo->summaries[stream].pure) {
+        if (top != NULL && top->peak < ctx->depth + 1) top->peak = ctx->depth + 1;
+        return 0;
+    }
+    summary = &memo->summaries[stream];
+    numKeys = gatherValues(ctx, memoKey(summary), values);
+    hash = hashValues(stream, values, numKeys);
+
+    for (MemoRecord* record = memo->buckets[hash & (memo->numBuckets - 1)]; record != NULL; record = record->next) {
+        if (record->hash != hash || record->stream != stream) continue;
+        if (memcmp(record->values, values, numKeys * sizeof(int)) != 0) continue;
+        if (ctx->depth + record->peak > ctx->maxDepth) break;
+
+        deltas = record->values + numKeys;
+        deltas += scatterValues(ctx, summary->writes & ~summary->accumulated, deltas);
+        for (int r = 0; r < 26; r++) {
+            if (!(summary->accumulated & FLOW_REG(r))) continue;
+            ctx->registers[r] = (int)((unsigned)ctx->registers[r] + (unsigned)*deltas++);
+        }
+        if (top != NULL && top->peak < ctx->depth + record->peak) top->peak = ctx->depth + record->peak;
+        memo->hits++;
+        return 1;
+    }
+    memo->misses++;
+
+    if (memo->numFrames == memo->maxFrames) {
+        int capacity = memo->maxFrames < MIN_CAPACITY ? MIN_CAPACITY : memo->maxFrames * 2;
+        MemoFrame* frames = realloc(memo->frames, capacity * sizeof(MemoFrame));
+
+        if (frames == NULL) {
+            if (top != NULL && top->peak < ctx->depth + 1) top->peak = ctx->depth + 1;
+            return 0;
+        }
+        memo->frames = frames;
+        memo->maxFrames = capacity;
+    }
+    top = &memo->frames[memo->numFrames++];
+    top->stream = stream;
+    top->base = ctx->depth;
+    top->peak = ctx->depth + 1;
+    memcpy(top->values, values, numKeys * sizeof(int));
+    gatherValues(ctx, summary->accumulated, top->values + numKeys);
+    return 0;
+}
+
+//after a return: when it ends the call being recorded on top, that call goes into the table.
+void finishCall(Memo* memo, Context* ctx) {
+    MemoFrame* frame;
+
+    if (memo->numFrames == 0 || memo->frames[memo->numFrames - 1].base != ctx->depth) return;
+    frame = &memo->frames[--memo->numFrames];
+    rememberCall(memo, frame, ctx);
+    if (memo->numFrames > 0 && memo->frames[memo->numFrames - 1].peak < frame->peak) {
+        memo->frames[memo->numFrames - 1].peak = frame->peak;
+    }
+}
+#endif
+
+//what a translated program needs to run, kept in step with reserveOutput, appendText, appendInt and pushReturn so
+//that it prints and fails exactly like the engines. guarded, so any number of programs can share a file.
+const char* translationRuntime =
+    "#ifndef ASM_TRANSLATION_RUNTIME\n"
+    "#define ASM_TRANSLATION_RUNTIME\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "struct asmOutput {\n"
+    "    char* data;\n"
+    "    int length;\n"
+    "    int capacity;\n"
+    "};\n"
+    "\n"
+    "static int asmReserve(struct asmOutput* out, int size) {\n"
+    "    int capacity = out->capacity;\n"
+    "    char* data;\n"
+    "\n"
+    "    if (out->length + size < capacity) return 0;\n"
+    "    while (out->length + size >= capacity) capacity = capacity == 0 ? 64 : capacity * 2;\n"
+    "    data = realloc(out->data, capacity);\n"
+    "    if (data == NULL) return -1;\n"
+    "    out->data = data;\n"
+    "    out->capacity = capacity;\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static void asmText(struct asmOutput* out, const char* text, int length) {\n"
+    "    if (asmReserve(out, length) == -1) return;\n"
+    "    memcpy(out->data + out->length, text, length);\n"
+    "    out->length += length;\n"
+    "    out->data[out->length] = '\\0';\n"
+    "}\n"
+    "\n"
+    "static void asmInt(struct asmOutput* out, int value) {\n"
+    "    static const char digitPairs[] =\n"
+    "        \"00010203040506070809101112131415161718192021222324252627282930313233343536373839\"\n"
+    "        \"40414243444546474849505152535455565758596061626364656667686970717273747576777879\"\n"
+    "        \"8081828384858687888990919293949596979899\";\n"
+    "    char digits[12];\n"
+    "    char* first = digits + sizeof(digits);\n"
+    "    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;\n"
+    "\n"
+    "    while (magnitude >= 100) {\n"
+    "        first -= 2;\n"
+    "        memcpy(first, digitPairs + (magnitude % 100) * 2, 2);\n"
+    "        magnitude /= 100;\n"
+    "    }\n"
+    "    if (magnitude >= 10) {\n"
+    "        first -= 2;\n"
+    "        memcpy(first, digitPairs + magnitude * 2, 2);\n"
+    "    } else {\n"
+    "        *--first = (char)('0' + magnitude);\n"
+    "    }\n"
+    "    if (value < 0) *--first = '-';\n"
+    "    asmText(out, first, digits + sizeof(digits) - first);\n"
+    "}\n"
+    "\n"
+    "static void asmMessage(struct asmOutput* out) {\n"
+    "    out->length = 0;\n"
+    "    if (out->data != NULL) out->data[0] = '\\0';\n"
+    "}\n"
+    "\n"
+    "static int asmGrow(int** stack, int* capacity, int depth, int maxDepth) {\n"
+    "    int grown = *capacity < 16 ? 16 : *capacity * 2;\n"
+    "    int* bigger;\n"
+    "\n"
+    "    if (depth >= maxDepth) return -1;\n"
+    "    if (grown > maxDepth) grown = maxDepth;\n"
+    "    bigger = realloc(*stack, grown * sizeof(int));\n"
+    "    if (bigger == NULL) return -1;\n"
+    "    *stack = bigger;\n"
+    "    *capacity = grown;\n"
+    "    return 0;\n"
+    "}\n"
+    "#endif\n";
+
+//a msg literal as a C string, every byte that is not plain printable text written as a three digit octal escape.
+void translateText(FILE* out, const char* text, int length) {
+    fputc('"', out);
+    for (int i = 0; i < length; i++) {
+        unsigned char c = text[i];
+
+        if (c < ' ' || c > '~' || c == '"' || c == '\\' || c == '?') fprintf(out, "\\%03o", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void translateOperand(FILE* out, int reg, int value) {
+    if (reg != NO_REG) fprintf(out, "%c", 'a' + reg);
+    else fprintf(out, "(%d)", value);
+}
+
+//ahead of time back end: writes pgm as a C function "char* symbol(void)" that returns what assembler_interpreter
+//would, for building with the system compiler. registers become locals and every stream entry a label, a call
+//pushes the index after it and goto's the entry, ret switches on the popped index. arithmetic is done unsigned
+//so it wraps the way the engines do. fused slots are written as the plain instructions they cover.
+int translateProgram(const Program* pgm, const char* symbol, FILE* out) {
+    Arena scratch = {0};
+    char* labelled = arenaAlloc(&scratch, pgm->numCode);
+    int numReturns = 0;
+
+    if (labelled == NULL) {
+        arenaFree(&scratch);
+        return -1;
+    }
+    labelled[0] = 1;
+    for (int i = 0; i < pgm->numCode; i++) {
+        int op = baseOpcode(pgm->code[i].opcode);
+
+        if (op != CMP && op >= JMP && op <= CLL) labelled[pgm->code[i].target] = 1;
+        if (op == CLL && i + 1 < pgm->numCode) {
+            labelled[i + 1] = 1;
+            numReturns++;
+        }
+    }
+
+    fprintf(out, "%s\n", translationRuntime);
+    fprintf(out, "char* %s(void) {\n", symbol);
+    fprintf(out, "    int a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0, i = 0, j = 0, k = 0, l = 0, m = 0;\n");
+    fprintf(out, "    int n = 0, o = 0, p = 0, q = 0, r = 0, s = 0, t = 0, u = 0, v = 0, w = 0, x = 0, y = 0, z = 0;\n");
+    fprintf(out, "    short cmpX = 0, cmpY = 0;\n");
+    fprintf(out, "    int* stack = NULL;\n");
+    fprintf(out, "    int depth = 0, capacity = 0, pc = 0;\n");
+    fprintf(out, "    struct asmOutput out = {calloc(64, 1), 0, 64};\n\n");
+    fprintf(out, "    if (out.data == NULL) return (char*) -1;\n");
+
+    for (int pc = 0; pc < pgm->numCode; pc++) {
+        const Bytecode* bc = &pgm->code[pc];
+        int op = baseOpcode(bc->opcode);
+        char to = 'a' + bc->toRegister;
+
+        if (labelled[pc]) fprintf(out, "L%d:\n", pc);
+        fprintf(out, "    ");
+        switch(op) {
+
+            case MOV:
+              fprintf(out, "%c = ", to);
+              translateOperand(out, bc->fromRegister, bc->value);
+              fprintf(out, ";\n");
+              break;
+
+            case INC: case DEC:
+              fprintf(out, "%c = (int)((unsigned)%c %c 1u);\n", to, to, op == INC ? '+' : '-');
+              break;
+
+            case ADD: case SUB: case MUL:
+              fprintf(out, "%c = (int)((unsigned)%c %c (unsigned)", to, to, op == ADD ? '+' : op == SUB ? '-' : '*');
+              translateOperand(out, bc->fromRegister, bc->value);
+              fprintf(out, ");\n");
+              break;
+
+            case DIV:
+              fprintf(out, "%c /= ", to);
+              translateOperand(out, bc->fromRegister, bc->value);
+              fprintf(out, ";\n");
+              break;
+
+            case CMP:
+              fprintf(out, "cmpX = (short)");
+              translateOperand(out, bc->toRegister, bc->value);
+              fprintf(out, "; cmpY = (short)");
+              translateOperand(out, bc->fromRegister, bc->operand);
+              fprintf(out, ";\n");
+              break;
+
+            case JMP:
+              fprintf(out, "goto L%d;\n", bc->target);
+              break;
+
+            case JNE: case JE: case JGE: case JG: case JLE: case JL: {
+              static const char* conditions[] = {
+                  [JNE] = "!=", [JE] = "==", [JGE] = ">=", [JG] = ">", [JLE] = "<=", [JL] = "<"
+              };
+
+              fprintf(out, "if (cmpX %s cmpY) goto L%d;\n", conditions[op], bc->target);
+              break;
+            }
+
+            case CLL:
+              fprintf(out, "if (depth == capacity && asmGrow(&stack, &capacity, depth, %d) == -1) goto fail;\n", pgm->maxDepth);
+              fprintf(out, "    stack[depth++] = %d;\n", pc + 1);
+              fprintf(out, "    goto L%d;\n", bc->target);
+              break;
+
+            case MSG:
+              fprintf(out, "asmMessage(&out);\n");
+              for (int i = pgm->messages[bc->operand]; i < pgm->messages[bc->operand + 1]; i++) {
+                  const MsgSegment* segment = &pgm->segments[i];
+
+                  if (segment->reg != NO_REG) {
+                      fprintf(out, "    asmInt(&out, %c);\n", 'a' + segment->reg);
+                  } else {
+                      fprintf(out, "    asmText(&out, ");
+                      translateText(out, pgm->text + segment->offset, segment->length);
+                      fprintf(out, ", %d);\n", segment->length);
+                  }
+              }
+              break;
+
+            case RET: case END:
+              fprintf(out, "goto ret;\n");
+              break;
+
+            case BADEND:
+              fprintf(out, "goto fail;\n");
+              break;
+        }
+    }
+
+    fprintf(out, "ret:\n");
+    fprintf(out, "    if (depth == 0) {\n        free(stack);\n        return out.data;\n    }\n");
+    fprintf(out, "    pc = stack[--depth];\n");
+    fprintf(out, "    switch (pc) {\n");
+    for (int pc = 1; pc < pgm->numCode && numReturns > 0; pc++) {
+        if (labelled[pc] && baseOpcode(pgm->code[pc - 1].opcode) == CLL) fprintf(out, "        case %d: goto L%d;\n", pc, pc);
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "fail:\n    free(stack);\n    free(out.data);\n    return (char*) -1;\n}\n");
+
+    arenaFree(&scratch);
+    return ferror(out) ? -1 : 0;
+}
+
+#ifdef ASM_COUNTERS
+//opens the counters of this thread disabled, they only count between startCounters and stopCounters.
+void openCounters(Counters* counters) {
+#if HAVE_COUNTERS
+    static const unsigned events[NUM_COUNTERS][2] = {
+        [COUNTER_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        [COUNTER_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        [COUNTER_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        [COUNTER_L1D_MISSES] = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                                    PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+        [COUNTER_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}
+    };
+#endif
+
+    memset(counters, 0, sizeof(Counters));
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        counters->fds[i] = -1;
+#if HAVE_COUNTERS
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i][0];
+        attr.config = events[i][1];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+        if (counters->fds[i] == -1) counters->values[i] = -1;
+    }
+}
+
+void closeCounters(Counters* counters) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->fds[i] != -1) close(counters->fds[i]);
+        counters->fds[i] = -1;
+    }
+}
+
+int countersAvailable(const Counters* counters) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->fds[i] != -1) return 1;
+    }
+    return 0;
+}
+
+void startCounters(Counters* counters) {
+#if HAVE_COUNTERS
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->fds[i] == -1) continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    counters->start = monotonicNow();
+}
+
+//adds what the counters saw since startCounters. a counter the kernel had to share with others only ran
+//part of the time, its count is scaled up to the whole phase.
+void stopCounters(Counters* counters) {
+    long long now = monotonicNow();
+
+#if HAVE_COUNTERS
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        unsigned long long reading[3];
+
+        if (counters->fds[i] == -1) continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counters->fds[i], reading, sizeof(reading)) != sizeof(reading) || reading[2] == 0) continue;
+        counters->values[i] += reading[2] < reading[1] ? (long long)((double)reading[0] * reading[1] / reading[2])
+                                                       : (long long)reading[0];
+    }
+#endif
+    counters->time += now - counters->start;
+    counters->runs++;
+}
+
+//assembler_interpreter with each phase measured: the lex phase is all of compileProgram, the execute phase
+//the run. either Counters may be NULL.
+char* measureRun(const char* source, Counters* lexPhase, Counters* executePhase) {
+    Program* pgm;
+    char* result;
+
+    if (lexPhase != NULL) startCounters(lexPhase);
+    pgm = compileProgram(source);
+    if (lexPhase != NULL) stopCounters(lexPhase);
+    if (pgm == NULL) return (char*) -1;
+
+    if (executePhase != NULL) startCounters(executePhase);
+    result = executeProgram(pgm);
+    if (executePhase != NULL) stopCounters(executePhase);
+    freeProgram(pgm);
+    return result;
+}
+#endif
+
+#if defined(LEXER_BENCHMARK) || defined(ASM_BENCHMARK)
+//a large program of many small subroutines, for the benchmarks that need more source than anyone writes by hand.
+char* generateSource(int numFunctions, size_t* size) {
+    size_t capacity = 256 * (size_t)numFunctions + 64;
+    char* source = malloc(capacity);
+
+    *size = 0;
+    for (int f = 0; f < numFunctions; f++) {
+        *size += sprintf(source + *size, "call step%d    ; next step\n", f);
+    }
+    *size += sprintf(source + *size, "msg 'done ', a\nend\n\n");
+    for (int f = 0; f < numFunctions; f++) {
+        *size += sprintf(source + *size, "step%d:\n    mov c, a\n    add c, 7   ; scratch value\n"
+                                         "    mul c, 3\n    cmp c, b\n    msg 'step ', c\n    inc a\n    ret\n\n", f);
+    }
+    return source;
+}
+#endif
+
+#ifdef LEXER_BENCHMARK
+//lexer throughput on a generated program of many small subroutines. build with -O2 -DLEXER_BENCHMARK and
+//once more with -DSCALAR_LEXER added for the byte-at-a-time baseline.
+int main(int argc, char** argv) {
+    int numFunctions = argc > 1 ? atoi(argv[1]) : 2000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    size_t size;
+    char* source = generateSource(numFunctions, &size);
+    long numTokens = 0;
+    struct timespec start, stop;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++) {
+        Compiler comp = {0};
+
+        lexer(source, &comp);
+        numTokens += comp.numTokens;
+        arenaFree(&comp.arena);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%d byte scanner: %.1f MB/s, %zu bytes x %d rounds, %ld tokens\n", LEXER_VECTOR,
+           (double)size * rounds / seconds / 1e6, size, rounds, numTokens);
+    free(source);
+    return 0;
+}
+#elif defined(ASM_BENCHMARK)
+//the benchmark corpus. each program ends on a msg that depends on all of its work, so no pass can drop any of it.
+const char* benchCorpus[][2] = {
+    {"count",
+        "mov i, 0\n"
+        "mov n, 0\n"
+        "call outer\n"
+        "msg 'count ', n\n"
+        "end\n"
+        "\n"
+        "outer:\n"
+        "    mov j, 0\n"
+        "    call inner\n"
+        "    inc i\n"
+        "    cmp i, 300\n"
+        "    jl outer\n"
+        "    ret\n"
+        "\n"
+        "inner:\n"
+        "    inc n\n"
+        "    inc j\n"
+        "    cmp j, 30000\n"
+        "    jl inner\n"
+        "    ret\n"},
+    {"factorial",
+        "mov i, 0\n"
+        "call bench\n"
+        "msg 'factorial ', r\n"
+        "end\n"
+        "\n"
+        "bench:\n"
+        "    mov n, 12\n"
+        "    mov r, 1\n"
+        "    call fact\n"
+        "    inc i\n"
+        "    cmp i, 30000\n"
+        "    jl bench\n"
+        "    ret\n"
+        "\n"
+        "fact:\n"
+        "    cmp n, 1\n"
+        "    jle factDone\n"
+        "    mul r, n\n"
+        "    dec n\n"
+        "    call fact\n"
+        "    ret\n"
+        "\n"
+        "factDone:\n"
+        "    ret\n"},
+    {"fibonacci",
+        "mov i, 0\n"
+        "call bench\n"
+        "msg 'fib = ', r\n"
+        "end\n"
+        "\n"
+        "bench:\n"
+        "    mov n, 20\n"
+        "    mov r, 0\n"
+        "    call fib\n"
+        "    inc i\n"
+        "    cmp i, 20\n"
+        "    jl bench\n"
+        "    ret\n"
+        "\n"
+        "fib:\n"
+        "    cmp n, 2\n"
+        "    jl fibBase\n"
+        "    dec n\n"
+        "    call fib\n"
+        "    dec n\n"
+        "    call fib\n"
+        "    add n, 2\n"
+        "    ret\n"
+        "\n"
+        "fibBase:\n"
+        "    add r, n\n"
+        "    ret\n"},
+    {"gcd",
+        "mov k, 0\n"
+        "mov s, 0\n"
+        "call rounds\n"
+        "msg 'gcd sum ', s\n"
+        "end\n"
+        "\n"
+        "rounds:\n"
+        "    mov i, 1\n"
+        "    call pairs\n"
+        "    inc k\n"
+        "    cmp k, 100\n"
+        "    jl rounds\n"
+        "    ret\n"
+        "\n"
+        "pairs:\n"
+        "    mov a, i\n"
+        "    mul a, 7\n"
+        "    add a, 13\n"
+        "    mov b, 1071\n"
+        "    call gcd\n"
+        "    add s, a\n"
+        "    inc i\n"
+        "    cmp i, 4000\n"
+        "    jle pairs\n"
+        "    ret\n"
+        "\n"
+        "gcd:\n"
+        "    cmp b, 0\n"
+        "    je gcdDone\n"
+        "    mov t, a\n"
+        "    div t, b\n"
+        "    mul t, b\n"
+        "    mov r, a\n"
+        "    sub r, t\n"
+        "    mov a, b\n"
+        "    mov b, r\n"
+        "    jmp gcd\n"
+        "\n"
+        "gcdDone:\n"
+        "    ret\n"},
+    {"power",
+        "mov k, 0\n"
+        "call rounds\n"
+        "msg 'power ', p\n"
+        "end\n"
+        "\n"
+        "rounds:\n"
+        "    mov p, 1\n"
+        "    mov e, 0\n"
+        "    call power\n"
+        "    inc k\n"
+        "    cmp k, 1000\n"
+        "    jl rounds\n"
+        "    ret\n"
+        "\n"
+        "power:\n"
+        "    mul p, 3\n"
+        "    mov q, p\n"
+        "    div q, 10007\n"
+        "    mul q, 10007\n"
+        "    sub p, q\n"
+        "    inc e\n"
+        "    cmp e, 1000\n"
+        "    jl power\n"
+        "    ret\n"},
+    {"calls",
+        "mov i, 0\n"
+        "mov c, 0\n"
+        "call outer\n"
+        "msg 'calls ', c\n"
+        "end\n"
+        "\n"
+        "outer:\n"
+        "    mov j, 0\n"
+        "    call inner\n"
+        "    inc i\n"
+        "    cmp i, 100\n"
+        "    jl outer\n"
+        "    ret\n"
+        "\n"
+        "inner:\n"
+        "    call levelOne\n"
+        "    inc j\n"
+        "    cmp j, 10000\n"
+        "    jl inner\n"
+        "    ret\n"
+        "\n"
+        "levelOne:\n"
+        "    call levelTwo\n"
+        "    ret\n"
+        "\n"
+        "levelTwo:\n"
+        "    call levelThree\n"
+        "    ret\n"
+        "\n"
+        "levelThree:\n"
+        "    call levelFour\n"
+        "    ret\n"
+        "\n"
+        "levelFour:\n"
+        "    inc c\n"
+        "    ret\n"},
+    {"output",
+        "mov i, 0\n"
+        "mov v, 7\n"
+        "call lines\n"
+        "msg 'last line ', i, ' value ', v\n"
+        "end\n"
+        "\n"
+        "lines:\n"
+        "    inc i\n"
+        "    add v, i\n"
+        "    msg 'line ', i, ' of the report, value ', v, ' running'\n"
+        "    cmp i, 30000\n"
+        "    jl lines\n"
+        "    ret\n"},
+};
+
+const char* engineNames[] = {"switch", "threaded", "jit"};
+
+typedef char* (*Translated)(void);
+
+void printJsonString(FILE* out, const char* text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') fprintf(out, "\\%c", *text);
+        else if ((unsigned char)*text < ' ') fprintf(out, "\\u%04x", *text);
+        else fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+char* readSource(const char* path) {
+    FILE* file = fopen(path, "rb");
+    char* source = NULL;
+    long size;
+
+    if (file == NULL) return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        source = malloc(size + 1);
+        if (source != NULL && fread(source, 1, size, file) != (size_t)size) {
+            free(source);
+            source = NULL;
+        }
+        if (source != NULL) source[size] = '\0';
+    }
+    fclose(file);
+    return source;
+}
+
+//instructions one run executes as written, the fuel a run of the unoptimized program spends, so the number stays
+//the same whatever the optimizer does to it. it is a run of its own, the timed runs are never metered.
+long long countInstructions(const char* source) {
+    Program* pgm = compileWithOptions(source, OPTIMIZE_NONE);
+    long long instructions = -1;
+    Context* ctx;
+    char* result;
+
+    if (pgm == NULL) return -1;
+    ctx = openRun(pgm);
+    if (ctx != NULL) {
+        if (resumeRun(ctx, FUEL_UNLIMITED - 1) != RUN_YIELDED) instructions = FUEL_UNLIMITED - 1 - ctx->fuel;
+        result = closeRun(ctx);
+        if (result != (char*) -1) free(result);
+    }
+    freeProgram(pgm);
+    return instructions;
+}
+
+//one JSON line per engine, every time the best of rounds runs. compile times are per phase.
+int benchProgram(const char* name, const char* source, int rounds) {
+    long long best[NUM_PHASES];
+    long long instructions = countInstructions(source);
+    long long allocations;
+    Program* pgm = NULL;
+
+    for (int p = 0; p < NUM_PHASES; p++) best[p] = -1;
+    allocations = benchAllocations;
+    for (int r = 0; r < rounds; r++) {
+        long long phaseTimes[NUM_PHASES] = {0};
+
+        if (pgm != NULL) freeProgram(pgm);
+        pgm = compileTimed(source, OPTIMIZE_ALL | OPTIMIZE_JIT, phaseTimes);
+        if (r == 0) allocations = benchAllocations - allocations;
+        for (int p = 0; p < NUM_PHASES; p++) {
+            if (best[p] == -1 || phaseTimes[p] < best[p]) best[p] = phaseTimes[p];
+        }
+    }
+    if (pgm == NULL) {
+        printf("{\"program\":");
+        printJsonString(stdout, name);
+        printf(",\"error\":\"compile\"}\n");
+        return -1;
+    }
+
+    for (int engine = ENGINE_SWITCH; engine <= ENGINE_JIT; engine++) {
+        long long execTime = -1;
+        long long execAllocations = 0;
+        char* result = NULL;
+
+        if (setEngine(pgm, engine) == -1) continue;
+        for (int r = 0; r < rounds; r++) {
+            long long start = monotonicNow();
+            long long before = benchAllocations;
+
+            if (result != NULL && result != (char*) -1) free(result);
+            result = executeProgram(pgm);
+            start = monotonicNow() - start;
+            execAllocations = benchAllocations - before;
+            if (execTime == -1 || start < execTime) execTime = start;
+        }
+
+        printf("{\"program\":");
+        printJsonString(stdout, name);
+        printf(",\"engine\":\"%s\",\"source_bytes\":%zu,\"code_size\":%d,\"instructions\":%lld,"
+               "\"lex_ns\":%lld,\"link_ns\":%lld,\"encode_ns\":%lld,\"load_ns\":%lld,\"compile_allocations\":%lld,"
+               "\"exec_ns\":%lld,\"instructions_per_second\":%.0f,\"exec_allocations\":%lld,\"result\":",
+               engineNames[engine], strlen(source), pgm->numCode, instructions,
+               best[PHASE_LEX], best[PHASE_LINK], best[PHASE_ENCODE], best[PHASE_LOAD], allocations,
+               execTime, execTime > 0 ? instructions * 1e9 / execTime : 0.0, execAllocations);
+        printJsonString(stdout, result == (char*) -1 ? "-1" : result);
+        printf("}\n");
+        if (result != (char*) -1) free(result);
+    }
+    freeProgram(pgm);
+    return 0;
+}
+
+//one JSON line for a measured phase: the time and every counter per run, and per instruction the program
+//executed when instructions is above 0. counters that are missing are null.
+void printCounters(const char* name, const char* phase, const char* engine, const Counters* counters,
+                   long long instructions) {
+    static const char* counterNames[NUM_COUNTERS] = {"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+    int runs = counters->runs > 0 ? counters->runs : 1;
+
+    printf("{\"program\":");
+    printJsonString(stdout, name);
+    printf(",\"phase\":\"%s\",\"engine\":\"%s\",\"counters\":%s,\"runs\":%d,\"ns\":%lld", phase, engine,
+           countersAvailable(counters) ? "true" : "false", counters->runs, counters->time / runs);
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (counters->values[i] == -1) printf(",\"%s\":null", counterNames[i]);
+        else printf(",\"%s\":%lld", counterNames[i], counters->values[i] / runs);
+    }
+    if (instructions > 0) {
+        printf(",\"per_instruction\":{\"ns\":%.3f", (double)counters->time / runs / instructions);
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            if (counters->values[i] == -1) printf(",\"%s\":null", counterNames[i]);
+            else printf(",\"%s\":%.3f", counterNames[i], (double)counters->values[i] / runs / instructions);
+        }
+        printf("}");
+    }
+    printf("}\n");
+}
+
+//the lex phase of a program, then its execute phase on every engine, each measured over rounds runs.
+int benchCounters(const char* name, const char* source, int rounds) {
+    long long instructions = countInstructions(source);
+    Counters counters;
+    Program* pgm = NULL;
+
+    openCounters(&counters);
+    for (int r = 0; r < rounds; r++) {
+        if (pgm != NULL) freeProgram(pgm);
+        startCounters(&counters);
+        pgm = compileProgram(source);
+        stopCounters(&counters);
+    }
+    closeCounters(&counters);
+    if (pgm == NULL) return -1;
+    printCounters(name, "lex", "none", &counters, 0);
+
+    for (int engine = ENGINE_SWITCH; engine <= ENGINE_JIT; engine++) {
+        if (setEngine(pgm, engine) == -1) continue;
+        openCounters(&counters);
+        for (int r = 0; r < rounds; r++) {
+            char* result;
+
+            startCounters(&counters);
+            result = executeProgram(pgm);
+            stopCounters(&counters);
+            if (result != (char*) -1) free(result);
+        }
+        closeCounters(&counters);
+        printCounters(name, "execute", engineNames[engine], &counters, instructions);
+    }
+    freeProgram(pgm);
+    return 0;
+}
+
+//runs a program on every engine, optimized and not, and reports every result that differs from the
+//unoptimized program on the switch engine. returns the number of differences.
+int verifyEngines(const char* name, const char* source) {
+    Program* reference = compileWithOptions(source, OPTIMIZE_NONE);
+    char* expected;
+    int mismatches = 0;
+
+    if (reference == NULL) return 0;
+    setEngine(reference, ENGINE_SWITCH);
+    expected = executeProgram(reference);
+
+    for (int options = OPTIMIZE_NONE; options <= OPTIMIZE_ALL; options += OPTIMIZE_ALL) {
+        Program* pgm = compileWithOptions(source, options);
+
+        for (int engine = ENGINE_SWITCH; pgm != NULL && engine <= ENGINE_JIT; engine++) {
+            char* result;
+
+            if (setEngine(pgm, engine) == -1) continue;
+            result = executeProgram(pgm);
+            if ((result == (char*) -1) != (expected == (char*) -1) ||
+                (result != (char*) -1 && strcmp(result, expected) != 0)) {
+                printf("{\"program\":");
+                printJsonString(stdout, name);
+                printf(",\"engine\":\"%s\",\"options\":%d,\"mismatch\":", engineNames[engine], options);
+                printJsonString(stdout, result == (char*) -1 ? "-1" : result);
+                printf(",\"expected\":");
+                printJsonString(stdout, expected == (char*) -1 ? "-1" : expected);
+                printf("}\n");
+                mismatches++;
+            }
+            if (result != (char*) -1) free(result);
+        }
+        if (pgm == NULL) mismatches++;
+        else freeProgram(pgm);
+    }
+    if (expected != (char*) -1) free(expected);
+    freeProgram(reference);
+    return mismatches;
+}
+
+//a program translated by translateProgram, built with $CC (cc when it is not set) and loaded. NULL when any of
+//that fails, otherwise *library is what to dlclose once done with it.
+Translated buildTranslation(const Program* pgm, void** library) {
+    char sourcePath[] = "/tmp/asmXXXXXX";
+    char libraryPath[] = "/tmp/asmXXXXXX";
+    char command[512];
+    const char* compiler = getenv("CC");
+    Translated function = NULL;
+    int sourceFd = mkstemp(sourcePath);
+    int libraryFd = mkstemp(libraryPath);
+    FILE* out = sourceFd != -1 ? fdopen(sourceFd, "w") : NULL;
+    int written = 0;
+
+    *library = NULL;
+    if (libraryFd != -1) close(libraryFd);
+    if (out != NULL) {
+        written = translateProgram(pgm, "translated", out) == 0;
+        written = fclose(out) == 0 && written;
+    } else if (sourceFd != -1) {
+        close(sourceFd);
+    }
+    if (written && libraryFd != -1) {
+        snprintf(command, sizeof(command), "%s -O2 -shared -fPIC -x c %s -o %s", compiler != NULL ? compiler : "cc",
+                 sourcePath, libraryPath);
+        if (system(command) == 0) *library = dlopen(libraryPath, RTLD_NOW | RTLD_LOCAL);
+        if (*library != NULL) function = (Translated)dlsym(*library, "translated");
+    }
+    if (sourceFd != -1) unlink(sourcePath);
+    if (libraryFd != -1) unlink(libraryPath);
+    return function;
+}
+
+//builds the translation of a program and runs it next to assembler_interpreter, one JSON line with the best
+//of rounds runs of each and whether the two results are identical. returns 1 when they are not.
+int verifyTranslation(const char* name, const char* source, int rounds) {
+    Program* pgm = compileWithOptions(source, OPTIMIZE_ALL);
+    long long buildTime = monotonicNow();
+    long long translatedTime = -1;
+    long long interpretedTime = -1;
+    char* expected = NULL;
+    char* result = NULL;
+    void* library;
+    Translated translated;
+    int mismatch;
+
+    if (pgm == NULL) return 0;
+    translated = buildTranslation(pgm, &library);
+    buildTime = monotonicNow() - buildTime;
+    freeProgram(pgm);
+    if (translated == NULL) {
+        printf("{\"program\":");
+        printJsonString(stdout, name);
+        printf(",\"engine\":\"aot\",\"error\":\"build\"}\n");
+        if (library != NULL) dlclose(library);
+        return 1;
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        long long start = monotonicNow();
+
+        if (expected != NULL && expected != (char*) -1) free(expected);
+        expected = assembler_interpreter(source);
+        start = monotonicNow() - start;
+        if (interpretedTime == -1 || start < interpretedTime) interpretedTime = start;
+
+        start = monotonicNow();
+        if (result != NULL && result != (char*) -1) free(result);
+        result = translated();
+        start = monotonicNow() - start;
+        if (translatedTime == -1 || start < translatedTime) translatedTime = start;
+    }
+    mismatch = (result == (char*) -1) != (expected == (char*) -1) ||
+               (result != (char*) -1 && strcmp(result, expected) != 0);
+
+    printf("{\"program\":");
+    printJsonString(stdout, name);
+    printf(",\"engine\":\"aot\",\"build_ns\":%lld,\"exec_ns\":%lld,\"interpreter_ns\":%lld,\"identical\":%s,\"result\":",
+           buildTime, translatedTime, interpretedTime, mismatch ? "false" : "true");
+    printJsonString(stdout, result == (char*) -1 ? "-1" : result);
+    if (mismatch) {
+        printf(",\"expected\":");
+        printJsonString(stdout, expected == (char*) -1 ? "-1" : expected);
+    }
+    printf("}\n");
+    if (result != (char*) -1) free(result);
+    if (expected != (char*) -1) free(expected);
+    dlclose(library);
+    return mismatch;
+}
+
+//build with -O2 -DASM_BENCHMARK. runs the built-in corpus and any program files given, one JSON object per
+//line so runs of two commits can be compared line by line. --rounds n picks the best of n runs of everything,
+//--verify only checks that every engine and optimization level agrees and exits with 1 when one does not.
+//--counters reads the hardware counters of the lex and execute phases instead, or just their time when the
+//machine does not let us. --aot translates every program to C, builds it with the system compiler and checks
+//that its result is identical to assembler_interpreter's, exiting with 1 when one is not.
+int main(int argc, char** argv) {
+    int rounds = 5;
+    int verify = 0;
+    int counters = 0;
+    int aot = 0;
+    int failed = 0;
+    int programs = 0;
+    int numCorpus = sizeof(benchCorpus) / sizeof(benchCorpus[0]);
+    size_t size;
+    char* generated = generateSource(2000, &size);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) verify = 1;
+        else if (strcmp(argv[i], "--counters") == 0) counters = 1;
+        else if (strcmp(argv[i], "--aot") == 0) aot = 1;
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) rounds = atoi(argv[++i]);
+    }
+    if (rounds < 1) rounds = 1;
+
+    for (int i = 0; i <= numCorpus; i++) {
+        const char* name = i < numCorpus ? benchCorpus[i][0] : "generated";
+        const char* source = i < numCorpus ? benchCorpus[i][1] : generated;
+
+        if (verify) failed += verifyEngines(name, source);
+        else if (aot) failed += verifyTranslation(name, source, rounds);
+        else if (counters) failed += benchCounters(name, source, rounds) == -1;
+        else failed += benchProgram(name, source, rounds) == -1;
+        programs++;
+    }
+    for (int i = 1; i < argc; i++) {
+        char* source;
+
+        if (strcmp(argv[i], "--verify") == 0 || strcmp(argv[i], "--counters") == 0 || strcmp(argv[i], "--aot") == 0) continue;
+        if (strcmp(argv[i], "--rounds") == 0) {
+            i++;
+            continue;
+        }
+        source = readSource(argv[i]);
+        if (source == NULL) {
+            fprintf(stderr, "can not read %s\n", argv[i]);
+            failed++;
+            continue;
+        }
+        if (verify) failed += verifyEngines(argv[i], source);
+        else if (aot) failed += verifyTranslation(argv[i], source, rounds);
+        else if (counters) failed += benchCounters(argv[i], source, rounds) == -1;
+        else failed += benchProgram(argv[i], source, rounds) == -1;
+        programs++;
+        free(source);
+    }
+    if (verify) printf("{\"verified\":%d,\"mismatches\":%d}\n", programs, failed);
+    free(generated);
+    return failed != 0;
+}
+#elif defined(ASM_SERVER)
+#define SERVER_SOCKET "/tmp/asm.sock"
+#define SERVER_CACHE 1024
+#define SERVER_BUFFER (64 << 10)
+#define SERVER_MAX_REQUEST (16 << 20)
+#define SERVER_FUEL 100000000LL
+#define SERVER_ERROR 0xFFFFFFFFu
+
+//a compiled program in the cache. the cache holds one reference and every run using it another, whoever drops
+//the last one frees it, so a program can be evicted while it is still running. newer and older link every cached
+//program in order of last use.
+struct cachedProgram {
+    struct cachedProgram* next;
+    struct cachedProgram* newer;
+    struct cachedProgram* older;
+    unsigned hash;
+    int length;
+    char* source;
+    Program* program;
+    int refs;
+};
+typedef struct cachedProgram CachedProgram;
+
+//programs by source text, shared by every connection. the least recently used, oldest, goes once it is full.
+//options are what every program is compiled with.
+struct programCache {
+    pthread_mutex_t lock;
+    CachedProgram** buckets;
+    int numBuckets;
+    int count;
+    int capacity;
+    int options;
+    CachedProgram* newest;
+    CachedProgram* oldest;
+    long long hits;
+    long long misses;
+};
+typedef struct programCache ProgramCache;
+
+struct serverConnection {
+    int fd;
+    ProgramCache* cache;
+    long long fuel;
+};
+typedef struct serverConnection ServerConnection;
+
+unsigned hashSource(const char* source, int length) {
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < length; i++) hash = (hash ^ (unsigned char)source[i]) * 16777619u;
+    return hash;
+}
+
+void releaseProgram(ProgramCache* cache, CachedProgram* entry) {
+    pthread_mutex_lock(&cache->lock);
+    if (--entry->refs > 0) entry = NULL;
+    pthread_mutex_unlock(&cache->lock);
+    if (entry != NULL) {
+        freeProgram(entry->program);
+        free(entry->source);
+        free(entry);
+    }
+}
+
+//the recency list, always changed with the lock held. a program that is used again moves to the newest end.
+void unlinkRecent(ProgramCache* cache, CachedProgram* entry) {
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+void pushRecent(ProgramCache* cache, CachedProgram* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+//drops the least recently used program from the cache, called with the lock held. only its own bucket is searched.
+void evictProgram(ProgramCache* cache) {
+    CachedProgram* entry = cache->oldest;
+    CachedProgram** link;
+
+    if (entry == NULL) return;
+    unlinkRecent(cache, entry);
+    link = &cache->buckets[entry->hash & (cache->numBuckets - 1)];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    cache->count--;
+    if (--entry->refs == 0) {
+        freeProgram(entry->program);
+        free(entry->source);
+        free(entry);
+    }
+}
+
+//the compiled form of source, with a reference taken for the caller. NULL when it does not compile. a program
+//missing from the cache is compiled outside the lock, if another connection got there first its copy is used.
+CachedProgram* acquireProgram(ProgramCache* cache, const char* source, int length) {
+    unsigned hash = hashSource(source, length);
+    CachedProgram** bucket = &cache->buckets[hash & (cache->numBuckets - 1)];
+    CachedProgram* entry;
+    Program* pgm;
+
+    pthread_mutex_lock(&cache->lock);
+    for (entry = *bucket; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->source, source, length) == 0) break;
+    }
+    if (entry != NULL) {
+        entry->refs++;
+        unlinkRecent(cache, entry);
+        pushRecent(cache, entry);
+        cache->hits++;
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    pgm = compileWithOptions(source, cache->options);
+    if (pgm == NULL) return NULL;
+    entry = malloc(sizeof(CachedProgram));
+    if (entry != NULL) entry->source = malloc(length);
+    if (entry == NULL || entry->source == NULL) {
+        free(entry);
+        freeProgram(pgm);
+        return NULL;
+    }
+    memcpy(entry->source, source, length);
+    entry->hash = hash;
+    entry->length = length;
+    entry->program = pgm;
+    entry->refs = 2;
+
+    pthread_mutex_lock(&cache->lock);
+    for (CachedProgram* other = *bucket; other != NULL; other = other->next) {
+        if (other->hash == hash && other->length == length && memcmp(other->source, source, length) == 0) {
+            other->refs++;
+            unlinkRecent(cache, other);
+            pushRecent(cache, other);
+            pthread_mutex_unlock(&cache->lock);
+            freeProgram(entry->program);
+            free(entry->source);
+            free(entry);
+            return other;
+        }
+    }
+    if (cache->count == cache->capacity) evictProgram(cache);
+    pushRecent(cache, entry);
+    entry->next = *bucket;
+    *bucket = entry;
+    cache->count++;
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+int writeAll(int fd, const char* data, int length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+//runs one request and appends its response: the result's length as 4 bytes in network order and the result,
+//or just SERVER_ERROR when the program fails the way assembler_interpreter returns (char*) -1 for, or has not
+//ended once it spent the connection's fuel. source is terminated in place for the lexer, the byte it overwrites
+//is put back. returns -1 when the response does not fit in memory, nothing is appended then and the connection
+//has to close, since every response after it would be out of step.
+int serveRequest(ServerConnection* conn, char* source, int length, OutputBuffer* out) {
+    char saved = source[length];
+    CachedProgram* entry;
+    Context* ctx;
+    char* result = (char*) -1;
+    int size;
+    uint32_t header;
+
+    source[length] = '\0';
+    entry = acquireProgram(conn->cache, source, length);
+    source[length] = saved;
+    if (entry != NULL) {
+        ctx = openRun(entry->program);
+        if (ctx != NULL) {
+            resumeRun(ctx, conn->fuel);
+            result = closeRun(ctx);
+        }
+        releaseProgram(conn->cache, entry);
+    }
+
+    size = result == (char*) -1 ? 0 : (int)strlen(result);
+    if (reserveOutput(out, sizeof(header) + size) == -1) {
+        if (result != (char*) -1) free(result);
+        return -1;
+    }
+    header = htonl(result == (char*) -1 ? SERVER_ERROR : (uint32_t)size);
+    appendText(out, (const char*)&header, sizeof(header));
+    if (result != (char*) -1) {
+        appendText(out, result, size);
+        free(result);
+    }
+    return 0;
+}
+
+//one connection. requests are a 4 byte length in network order and that much program source, and may be sent
+//without waiting for answers. every complete request read is answered in order and the answers go back in one
+//write, so a pipelined batch costs one read and one write. a request over SERVER_MAX_REQUEST, or a response
+//that does not fit in memory, closes it.
+void* serveConnection(void* arg) {
+    ServerConnection* conn = arg;
+    OutputBuffer out = {0};
+    int capacity = SERVER_BUFFER;
+    int length = 0;
+    char* in = malloc(capacity);
+
+    while (in != NULL) {
+        int consumed = 0;
+        ssize_t received = read(conn->fd, in + length, capacity - length - 1);
+
+        if (received == -1 && errno == EINTR) continue;
+        if (received <= 0) break;
+        length += received;
+
+        while (length - consumed >= 4) {
+            uint32_t size;
+
+            memcpy(&size, in + consumed, sizeof(size));
+            size = ntohl(size);
+            if (size > SERVER_MAX_REQUEST) {
+                length = -1;
+                break;
+            }
+            if (length - consumed - 4 < (int)size) {
+                if ((int)size + 5 > capacity) {
+                    char* bigger = realloc(in, size + 5);
+
+                    if (bigger == NULL) length = -1;
+                    else in = bigger;
+                    capacity = size + 5;
+                }
+                break;
+            }
+            if (serveRequest(conn, in + consumed + 4, size, &out) == -1) {
+                length = -1;
+                break;
+            }
+            consumed += 4 + size;
+        }
+        if (length == -1) break;
+        memmove(in, in + consumed, length - consumed);
+        length -= consumed;
+        if (out.length > 0 && writeAll(conn->fd, out.data, out.length) == -1) break;
+        out.length = 0;
+    }
+
+    close(conn->fd);
+    free(in);
+    free(out.data);
+    free(conn);
+    return NULL;
+}
+
+//build with -O2 -DASM_SERVER and run as asm-server [socket path] [--cache n] [--fuel n]. it listens on the path,
+//by default SERVER_SOCKET, and serves every connection on a thread of its own out of one cache of compiled
+//programs. a run gets fuel instructions, SERVER_FUEL by default and 0 for no limit, so a program that never ends
+//can not hold on to its thread. native code can not be metered, programs are only JIT compiled with no limit.
+int main(int argc, char** argv) {
+    const char* path = SERVER_SOCKET;
+    struct sockaddr_un address;
+    ProgramCache cache;
+    long long fuel = SERVER_FUEL;
+    int listener;
+
+    memset(&cache, 0, sizeof(ProgramCache));
+    cache.capacity = SERVER_CACHE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) cache.capacity = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) fuel = atoll(argv[++i]);
+        else path = argv[i];
+    }
+    if (cache.capacity < 1) cache.capacity = 1;
+    cache.options = fuel > 0 ? OPTIMIZE_ALL : OPTIMIZE_ALL | OPTIMIZE_JIT;
+    cache.numBuckets = MIN_CAPACITY;
+    while (cache.numBuckets < cache.capacity) cache.numBuckets *= 2;
+    cache.buckets = calloc(cache.numBuckets, sizeof(CachedProgram*));
+    pthread_mutex_init(&cache.lock, NULL);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (cache.buckets == NULL || strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "can not serve on %s\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    signal(SIGPIPE, SIG_IGN);
+    unlink(path);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1 || bind(listener, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(listener, 64) == -1) {
+        perror(path);
+        return 1;
+    }
+
+    while (1) {
+        ServerConnection* conn;
+        pthread_t thread;
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        conn = malloc(sizeof(ServerConnection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->cache = &cache;
+        conn->fuel = fuel;
+        if (pthread_create(&thread, NULL, serveConnection, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(listener);
+    return 1;
+}
+#endif
\ No newline at end of file